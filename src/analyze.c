@@ -0,0 +1,263 @@
+#include "analyze.h"
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#if defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+#if defined (HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
+#include "samplelog.h"
+
+#define log_err(M, ...) fprintf(stderr, "%s:%d: errno: %s " M "\n", __FILE__, __LINE__, strerror(errno), ##__VA_ARGS__)
+
+/* files below this size are not worth splitting across threads */
+#define MIN_CHUNK (1 << 20)
+
+#define MAX_JOBS 64
+
+/* the part of a file one thread works on */
+typedef struct {
+	const char *p, *end;		/* text */
+	const slog_record_t *rec;	/* or binary records */
+	size_t nrec;
+	histogram_t h;
+	uint64_t invalid;
+} job_t;
+
+/* Parses lines of milliseconds as written by -o ("%8.2f") into
+ * nanoseconds. Fixed point with up to six decimals instead of strtod(),
+ * which would dominate the run time on large files.
+ */
+static void parse_text(job_t *j)
+{
+	const char *p = j->p, *end = j->end;
+
+	while (p < end) {
+		uint64_t ip = 0, frac = 0;
+		int fd = 0, any = 0;
+
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+
+		if (p < end && (*p == '\n' || *p == '\r')) {
+			p++;
+			continue;
+		}
+
+		while (p < end && (unsigned)(*p - '0') < 10) {
+			ip = ip * 10 + (*p++ - '0');
+			any = 1;
+		}
+
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && (unsigned)(*p - '0') < 10) {
+				if (fd < 6) {
+					frac = frac * 10 + (*p - '0');
+					fd++;
+				}
+				p++;
+				any = 1;
+			}
+		}
+
+		for (; fd < 6; ++fd)
+			frac *= 10;
+
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+
+		if (any && (p == end || *p == '\n')) {
+			histogram_add(&j->h, ip * 1000000 + frac);
+		} else {
+			j->invalid++;
+			while (p < end && *p != '\n')
+				p++;
+		}
+
+		if (p < end)
+			p++;
+	}
+}
+
+static void parse_binary(job_t *j)
+{
+	size_t i;
+
+	for (i = 0; i < j->nrec; ++i) {
+		const slog_record_t *r = &j->rec[i];
+		/* unused space after a crashed writer */
+		if (r->rx_ns == 0)
+			continue;
+		histogram_add(&j->h, r->rx_ns - r->tx_ns);
+	}
+}
+
+static void *run_job(void *arg)
+{
+	job_t *j = arg;
+
+	if (j->rec)
+		parse_binary(j);
+	else
+		parse_text(j);
+
+	return NULL;
+}
+
+static int is_binary(const char *buf, size_t len)
+{
+	const slog_header_t *hdr = (const slog_header_t *)buf;
+
+	return len >= SLOG_HEADER_SIZE && !memcmp(hdr->magic, SLOG_MAGIC, sizeof SLOG_MAGIC);
+}
+
+/* adds the samples in buf to h, using up to jobs threads */
+static int analyze_buf(const char *buf, size_t len, histogram_t *h, int jobs, analyze_result_t *res)
+{
+	job_t *job;
+	int i, n;
+
+	if (jobs > MAX_JOBS) jobs = MAX_JOBS;
+	n = len / MIN_CHUNK + 1;
+	if (n > jobs) n = jobs;
+	if (n < 1) n = 1;
+
+	job = calloc(n, sizeof *job);
+	if (!job)
+		return -1;
+
+	res->binary = is_binary(buf, len);
+
+	if (res->binary) {
+		const slog_header_t *hdr = (const slog_header_t *)buf;
+
+		if (hdr->record_size != sizeof(slog_record_t) || hdr->header_size > len) {
+			fprintf(stderr, "unsupported sample log format\n");
+			free(job);
+			return -1;
+		}
+
+		const slog_record_t *rec = (const slog_record_t *)(buf + hdr->header_size);
+		size_t nrec = (len - hdr->header_size) / sizeof *rec;
+
+		for (i = 0; i < n; ++i) {
+			job[i].rec = rec + nrec * i / n;
+			job[i].nrec = nrec * (i + 1) / n - nrec * i / n;
+		}
+	} else {
+		const char *p = buf, *end = buf + len;
+
+		/* split at line ends */
+		for (i = 0; i < n; ++i) {
+			const char *e = i == n - 1 ? end : buf + len * (i + 1) / n;
+			while (e < end && e[-1] != '\n')
+				e++;
+			if (e < p)
+				e = p;
+			job[i].p = p;
+			job[i].end = e;
+			p = e;
+		}
+	}
+
+	for (i = 0; i < n; ++i)
+		histogram_reset(&job[i].h);
+
+#if defined (HAVE_PTHREAD_H)
+	pthread_t tid[MAX_JOBS];
+
+	for (i = 1; i < n; ++i) {
+		if (pthread_create(&tid[i], NULL, run_job, &job[i]) != 0) {
+			run_job(&job[i]);
+			tid[i] = 0;
+		}
+	}
+	run_job(&job[0]);
+	for (i = 1; i < n; ++i) {
+		if (tid[i])
+			pthread_join(tid[i], NULL);
+	}
+#else
+	for (i = 0; i < n; ++i)
+		run_job(&job[i]);
+#endif
+
+	for (i = 0; i < n; ++i) {
+		res->samples += job[i].h.total;
+		res->invalid += job[i].invalid;
+		histogram_merge(h, &job[i].h);
+	}
+
+	res->bytes = len;
+
+	free(job);
+
+	return 0;
+}
+
+/* adds the samples of a -o or --log file to h, returns 0 on success */
+int analyze_file(const char *path, histogram_t *h, int jobs, analyze_result_t *res)
+{
+	struct stat st;
+	int fd, r;
+
+	memset(res, 0, sizeof *res);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		log_err("unable to open %s", path);
+		return -1;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		log_err("fstat() failed");
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size == 0) {
+		close(fd);
+		return 0;
+	}
+
+#if defined (HAVE_SYS_MMAN_H)
+	void *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (buf == MAP_FAILED) {
+		log_err("mmap() failed");
+		close(fd);
+		return -1;
+	}
+#ifdef MADV_SEQUENTIAL
+	madvise(buf, st.st_size, MADV_SEQUENTIAL);
+#endif
+	r = analyze_buf(buf, st.st_size, h, jobs, res);
+	munmap(buf, st.st_size);
+#else
+	char *buf = malloc(st.st_size);
+	if (!buf || read(fd, buf, st.st_size) != st.st_size) {
+		log_err("unable to read %s", path);
+		free(buf);
+		close(fd);
+		return -1;
+	}
+	r = analyze_buf(buf, st.st_size, h, jobs, res);
+	free(buf);
+#endif
+
+	close(fd);
+
+	return r;
+}
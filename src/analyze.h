@@ -0,0 +1,26 @@
+#ifndef ANALYZE_H
+#define ANALYZE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/* what analyze_file() found in a file */
+typedef struct {
+	uint64_t samples;
+	uint64_t invalid;	/* lines that are no number */
+	uint64_t bytes;
+	int binary;		/* a --log file rather than -o text */
+} analyze_result_t;
+
+	int analyze_file(const char *path, histogram_t *h, int jobs, analyze_result_t *res);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
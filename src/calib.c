@@ -0,0 +1,144 @@
+#include "calib.h"
+#include "seriallatency.h"
+#include "serial.h"
+#include "emulate.h"
+#include "hr_timer.h"
+
+#include <stdio.h>
+#include <string.h>
+#if !defined (_WIN32)
+#include <unistd.h>
+#endif
+
+/* rounds that warm up the caches and the peer before measuring */
+#define CALIB_WARMUP 16
+
+static const char *calib_names[CALIB_COUNT] = { "none", "tool", "pty" };
+
+/* returns the CALIB_* floor of given name, or -1 */
+int calib_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < CALIB_COUNT; ++i)
+		if (strcmp(name, calib_names[i]) == 0)
+			return i;
+
+	return -1;
+}
+
+const char *calib_name(int what)
+{
+	return calib_names[what];
+}
+
+#if !defined (_WIN32)
+/* write() and read() of len bytes through a pipe, i.e. a roundtrip of the
+   tester over a link that takes no time at all */
+static void calib_syscall(calib_t *c, int len, int rounds)
+{
+	uint8_t tx[4096], rx[4096];
+	serial_wait_t w = { SERIAL_WAIT_SELECT, -1, SERIAL_TIMEOUT_MS };
+	int fds[2], i;
+
+	if (pipe(fds) < 0)
+		return;
+
+	memset(tx, 0x55, len);
+
+	for (i = -CALIB_WARMUP; i < rounds; ++i) {
+		timerStruct begin, end;
+
+		GetHighResolutionTime(&begin);
+		if (write(fds[1], tx, len) != len ||
+		    serial_read_wait(fds[0], &w, rx, len) != len)
+			break;
+		GetHighResolutionTime(&end);
+
+		if (i >= 0)
+			histogram_add(&c->syscall, ConvertTimeDifferenceToNs(&end, &begin));
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+}
+#endif
+
+#if defined (HAVE_POSIX_OPENPT) && defined (HAVE_TERMIOS_H)
+/* roundtrips through a pty whose peer echoes at once, waiting the way the
+   run will. This is all the run measures on a link without any latency. */
+static void calib_pty(calib_t *c, int strategy, int baud, int len, int rounds)
+{
+	sl_session_t *s;
+	sl_config_t cfg;
+	emu_model_t m;
+	emu_t e;
+	int i;
+
+	memset(&m, 0, sizeof m);
+
+	if (emulate_start(&e, &m) < 0) {
+		emulate_stop(&e);
+		return;
+	}
+
+	sl_config_default(&cfg);
+	cfg.baud = baud;
+	cfg.count = len;
+	cfg.wait = serial_wait_name(strategy);
+
+	s = sl_open(e.name);
+
+	if (s && sl_configure(s, &cfg) == 0) {
+		for (i = -CALIB_WARMUP; i < rounds; ++i) {
+			uint64_t ns;
+
+			if (sl_sample(s, &ns) != SL_OK) {
+				/* the peer went away, rather no floor than a wrong one */
+				histogram_reset(&c->pty);
+				break;
+			}
+
+			if (i >= 0)
+				histogram_add(&c->pty, ns);
+		}
+	}
+
+	sl_close(s);
+	emulate_stop(&e);
+}
+#endif
+
+/* measures the noise floor with packets of len bytes, rounds times each */
+void calib_run(calib_t *c, int strategy, int baud, int len, int rounds)
+{
+	histogram_reset(&c->syscall);
+	histogram_reset(&c->pty);
+
+	c->stamp_ns = hr_timer_cost_ns();
+
+	if (len > 4096)
+		len = 4096;
+
+#if !defined (_WIN32)
+	calib_syscall(c, len, rounds);
+#endif
+#if defined (HAVE_POSIX_OPENPT) && defined (HAVE_TERMIOS_H)
+	calib_pty(c, strategy, baud, len, rounds);
+#endif
+}
+
+/* returns what --subtract takes off every sample. That is the fastest
+   roundtrip seen rather than a typical one, so no sample is corrected by
+   more than the tester could possibly have added to it. */
+uint64_t calib_floor(const calib_t *c)
+{
+	switch (c->subtract) {
+	case CALIB_TOOL:
+		return c->syscall.total ? c->syscall.min + (uint64_t)c->stamp_ns : 0;
+	case CALIB_PTY:
+		return c->pty.total ? c->pty.min : 0;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/* what --subtract takes off every sample */
+enum {
+	CALIB_NONE,
+	CALIB_TOOL,		/* time stamps plus the write() and read() calls */
+	CALIB_PTY,		/* a roundtrip through a pty that echoes at once */
+	CALIB_COUNT
+};
+
+/* the noise floor of the tester itself, measured before each run */
+typedef struct {
+	double stamp_ns;	/* one time stamp */
+	histogram_t syscall;	/* write() and read() of a packet through a pipe */
+	histogram_t pty;	/* roundtrip through a zero delay --emulate peer,
+				   empty if there are no pseudo terminals */
+	int subtract;		/* CALIB_* */
+} calib_t;
+
+	int      calib_parse(const char *name);
+	const char *calib_name(int what);
+	void     calib_run(calib_t *c, int strategy, int baud, int len, int rounds);
+	uint64_t calib_floor(const calib_t *c);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+#include "compare.h"
+
+#include <stdio.h>
+#include <math.h>
+
+/* two sided 95% quantile of the normal distribution */
+#define Z95 1.959964
+
+/* The k-th smallest of n samples lies below the p-th percentile with the
+   probability of at least k successes in n draws of p. With the normal
+   approximation of that binomial distribution, ranks within
+   n p +- z sqrt(n p (1 - p)) of the median rank bracket the percentile.
+   This needs no assumption about the latency distribution itself. */
+void compare_percentile(const histogram_t *h, double p, compare_ci_t *ci)
+{
+	double n = h->total, q = p / 100.0;
+	double r = n * q, d = Z95 * sqrt(n * q * (1 - q));
+
+	ci->value = histogram_percentile(h, p);
+	ci->lo = histogram_rank(h, r - d < 1 ? 1 : floor(r - d));
+	ci->hi = histogram_rank(h, ceil(r + d) + 1);
+}
+
+/* Kolmogorov's limit distribution, the probability of a KS statistic of
+   at least lambda / sqrt(n) for two samples from the same distribution */
+static double ks_q(double lambda)
+{
+	double sum = 0, sign = 1;
+	int k;
+
+	if (lambda < 0.2)
+		return 1;
+
+	for (k = 1; k <= 100; ++k) {
+		double term = exp(-2.0 * k * k * lambda * lambda);
+		sum += sign * term;
+		if (term < 1e-12)
+			break;
+		sign = -sign;
+	}
+
+	return fmin(fmax(2 * sum, 0), 1);
+}
+
+/* Two sample Kolmogorov-Smirnov test: the largest distance of the two
+   cumulative distributions. Within a bucket both are unknown, so the
+   distance is taken at the bucket edges only and can come out slightly
+   smaller than that of the raw samples. */
+double compare_ks(const histogram_t *a, const histogram_t *b, double *pvalue)
+{
+	uint64_t ca = 0, cb = 0;
+	double d = 0;
+	int i;
+
+	if (a->total == 0 || b->total == 0) {
+		*pvalue = 1;
+		return 0;
+	}
+
+	for (i = 0; i < HIST_BUCKETS; ++i) {
+		ca += a->counts[i];
+		cb += b->counts[i];
+		d = fmax(d, fabs((double)ca / a->total - (double)cb / b->total));
+	}
+
+	double ne = (double)a->total * b->total / (a->total + b->total);
+	*pvalue = ks_q((sqrt(ne) + 0.12 + 0.11 / sqrt(ne)) * d);
+
+	return d;
+}
+
+static void print_row(const char *name, const compare_ci_t *base, const compare_ci_t *cur)
+{
+	printf(" %7s %9.3f [%9.3f .. %9.3f] %9.3f [%9.3f .. %9.3f] %+8.1f%%\n", name,
+	       base->value / 1e6, base->lo / 1e6, base->hi / 1e6,
+	       cur->value / 1e6, cur->lo / 1e6, cur->hi / 1e6,
+	       base->value ? 100.0 * ((double)cur->value - base->value) / base->value : 0);
+}
+
+/* prints the percentiles of both runs with their 95% confidence intervals
+   and the KS test, returns 1 if the tail percentile of cur is worse than
+   that of base by more than threshold percent beyond doubt, i.e. even
+   the lower end of its interval exceeds the upper end of base's by that */
+int compare_report(const histogram_t *base, const histogram_t *cur,
+                   double tail, double threshold)
+{
+	static const double ps[] = { 50, 90, 99, 99.9, 99.99 };
+	compare_ci_t b, c;
+	char name[16];
+	unsigned i;
+
+	printf(" %7s %9s %-24s %9s %-24s %9s\n", "", "base [ms]", "  95% conf. interval",
+	       "new [ms]", "  95% conf. interval", "delta");
+
+	for (i = 0; i < sizeof ps / sizeof ps[0]; ++i) {
+		snprintf(name, sizeof name, "p%g", ps[i]);
+		compare_percentile(base, ps[i], &b);
+		compare_percentile(cur, ps[i], &c);
+		print_row(name, &b, &c);
+	}
+
+	b.value = b.lo = b.hi = base->max;
+	c.value = c.lo = c.hi = cur->max;
+	print_row("max", &b, &c);
+
+	double pvalue, d = compare_ks(base, cur, &pvalue);
+
+	printf("\n> Kolmogorov-Smirnov: D = %.4f, p = %.3g, the distributions %s\n", d, pvalue,
+	       pvalue < 0.05 ? "differ" : "do not differ significantly");
+
+	compare_percentile(base, tail, &b);
+	compare_percentile(cur, tail, &c);
+
+	double limit = b.hi * (1 + threshold / 100.0);
+	int regression = c.lo > limit;
+
+	printf("> p%g is %+.1f%% (limit %+.1f%%): %s\n", tail,
+	       b.value ? 100.0 * ((double)c.value - b.value) / b.value : 0, threshold,
+	       regression ? "REGRESSION" : "ok");
+
+	return regression;
+}
@@ -0,0 +1,27 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/* confidence interval of a percentile, from the ranks the binomial
+   distribution allows for it */
+typedef struct {
+	uint64_t value, lo, hi;
+} compare_ci_t;
+
+	void   compare_percentile(const histogram_t *h, double p, compare_ci_t *ci);
+	double compare_ks(const histogram_t *a, const histogram_t *b, double *pvalue);
+	int    compare_report(const histogram_t *base, const histogram_t *cur,
+	                      double tail, double threshold);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+#include "emulate.h"
+#include "pace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#if defined (HAVE_POSIX_OPENPT)
+#include <termios.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#endif
+
+#define clean_errno() (errno == 0 ? "None" : strerror(errno))
+#define log_err(M, ...) fprintf(stderr, "%s:%d: errno: %s " M "\n", __FILE__, __LINE__, clean_errno(), ##__VA_ARGS__)
+
+#if defined (HAVE_POSIX_OPENPT)
+
+/* bytes on their way back, at most QUEUE_LEN */
+#define QUEUE_LEN 65536
+
+typedef struct {
+	uint8_t data[QUEUE_LEN];
+	uint64_t due[QUEUE_LEN];	/* ns when the byte is echoed */
+	unsigned head, tail;		/* free running, index % QUEUE_LEN */
+} queue_t;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* schedules the n bytes just read at now for their echo */
+static void enqueue(queue_t *q, const emu_model_t *m, pace_t *rng, const uint8_t *buf, int n,
+                    uint64_t now, uint64_t start, uint64_t *wire_free)
+{
+	double byte_ns = m->baud > 0 ? 1e9 * m->frame_bits / m->baud : 0;
+	double jitter = 0;
+	uint64_t last = q->head != q->tail ? q->due[(q->tail - 1) % QUEUE_LEN] : 0;
+	int i;
+
+	if (m->jitter_ns > 0)
+		jitter = m->jitter_dist == PACE_UNIFORM ? m->jitter_ns * pace_random(rng) : pace_gap(rng);
+
+	for (i = 0; i < n; ++i) {
+		if (m->loss > 0 && pace_random(rng) < m->loss)
+			continue;
+
+		/* the byte is on the wire once the ones before it are through */
+		if (*wire_free < now)
+			*wire_free = now;
+		*wire_free += byte_ns;
+
+		uint64_t due = *wire_free + m->delay_ns + jitter;
+
+		if (m->batch_ns > 0) {
+			uint64_t b = m->batch_ns;
+			due = start + (due - start + b - 1) / b * b;
+		}
+
+		/* bytes do not overtake each other */
+		if (due < last)
+			due = last;
+		last = due;
+
+		q->data[q->tail % QUEUE_LEN] = buf[i];
+		q->due[q->tail % QUEUE_LEN] = due;
+		q->tail++;
+	}
+}
+
+/* echoes all bytes that are due, returns -1 if the master is gone */
+static int flush_due(int master, queue_t *q, uint64_t now)
+{
+	uint8_t out[4096];
+	int n = 0;
+
+	while (q->head != q->tail && q->due[q->head % QUEUE_LEN] <= now && n < (int)sizeof out)
+		out[n++] = q->data[q->head++ % QUEUE_LEN];
+
+	if (n > 0 && write(master, out, n) != n)
+		return -1;
+
+	return 0;
+}
+
+static void peer(int master, const emu_model_t *m, pid_t parent)
+{
+	static queue_t q;
+	uint8_t buf[4096];
+	uint64_t start = now_ns(), wire_free = 0;
+	pace_t rng;
+
+	/* a ^C is for the tester, which stops the peer when done with a
+	   SIGTERM that must not run a handler inherited from it */
+	signal(SIGINT, SIG_IGN);
+	signal(SIGTERM, SIG_DFL);
+
+	pace_init(&rng, m->jitter_dist, m->jitter_ns, 0, m->seed);
+
+	for (;;) {
+		uint64_t now = now_ns();
+		struct timeval tv = { 1, 0 };
+		fd_set fds;
+
+		if (flush_due(master, &q, now) < 0)
+			break;
+
+		if (q.head != q.tail) {
+			uint64_t due = q.due[q.head % QUEUE_LEN];
+			uint64_t wait = due > now ? due - now : 0;
+			tv.tv_sec = wait / 1000000000;
+			tv.tv_usec = (wait % 1000000000 + 999) / 1000;
+		}
+
+		FD_ZERO(&fds);
+		if (q.tail - q.head < QUEUE_LEN - sizeof buf)
+			FD_SET(master, &fds);
+
+		int r = select(master + 1, &fds, NULL, NULL, &tv);
+
+		if (r < 0 && errno != EINTR)
+			break;
+
+		if (getppid() != parent)
+			break;
+
+		if (r > 0 && FD_ISSET(master, &fds)) {
+			int n = read(master, buf, sizeof buf);
+			if (n < 0 && errno != EAGAIN && errno != EINTR)
+				break;
+			if (n > 0)
+				enqueue(&q, m, &rng, buf, n, now_ns(), start, &wire_free);
+		}
+	}
+
+	_exit(0);
+}
+
+/* creates a pty pair and forks a peer that echoes what is written to the
+   slave side through the link model m */
+int emulate_start(emu_t *e, const emu_model_t *m)
+{
+	struct termios tio;
+	const char *name;
+	pid_t parent = getpid();
+
+	memset(e, 0, sizeof *e);
+	e->slave = -1;
+
+	e->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (e->master < 0 || grantpt(e->master) < 0 || unlockpt(e->master) < 0 ||
+	    !(name = ptsname(e->master))) {
+		log_err("unable to create a pseudo terminal");
+		return -1;
+	}
+
+	snprintf(e->name, sizeof e->name, "%s", name);
+
+	/* held open so the peer does not see a hangup before the tester
+	   opens the port, and raw so no byte gets translated */
+	e->slave = open(e->name, O_RDWR | O_NOCTTY);
+	if (e->slave < 0 || tcgetattr(e->slave, &tio) < 0) {
+		log_err("unable to open %s", e->name);
+		return -1;
+	}
+
+	cfmakeraw(&tio);
+	tcsetattr(e->slave, TCSANOW, &tio);
+
+	fflush(stdout);
+	fflush(stderr);
+
+	e->pid = fork();
+
+	if (e->pid < 0) {
+		log_err("fork() failed");
+		return -1;
+	}
+
+	if (e->pid == 0) {
+		close(e->slave);
+		peer(e->master, m, parent);
+	}
+
+	return 0;
+}
+
+void emulate_stop(emu_t *e)
+{
+	if (e->pid > 0) {
+		kill(e->pid, SIGTERM);
+		waitpid(e->pid, NULL, 0);
+	}
+
+	if (e->slave >= 0)
+		close(e->slave);
+	close(e->master);
+}
+
+#else
+
+int emulate_start(emu_t *e, const emu_model_t *m)
+{
+	fprintf(stderr, "pseudo terminals are not supported on this system\n");
+	return -1;
+}
+
+void emulate_stop(emu_t *e)
+{
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef EMULATE_H
+#define EMULATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* the link the --emulate peer plays */
+typedef struct {
+	double delay_ns;	/* fixed latency */
+	double jitter_ns;	/* extra latency per burst: max of uniform, mean of exp */
+	int jitter_dist;	/* PACE_FIXED, PACE_UNIFORM or PACE_EXP */
+	double batch_ns;	/* hold the bytes back until the next multiple of
+				   this since the start, like USB frames */
+	double loss;		/* probability to lose a byte */
+	int baud, frame_bits;	/* bytes take frame_bits / baud on the wire */
+	uint64_t seed;
+} emu_model_t;
+
+typedef struct {
+	pid_t pid;		/* the peer */
+	int master, slave;
+	char name[64];		/* of the slave side, to open as the port */
+} emu_t;
+
+	int  emulate_start(emu_t *e, const emu_model_t *m);
+	void emulate_stop(emu_t *e);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,249 @@
+#include "harden.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#if defined (HAVE_SCHED_H)
+#include <sched.h>
+#endif
+#if defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+#if defined (HAVE_MALLOC_H)
+#include <malloc.h>
+#endif
+#if defined (HAVE_ALLOCA_H)
+#include <alloca.h>
+#endif
+
+#define log_err(M, ...) fprintf(stderr, "%s:%d: errno: %s " M "\n", __FILE__, __LINE__, strerror(errno), ##__VA_ARGS__)
+
+/* touches stack_bytes of stack below the caller, so the measurement does
+   not fault it in on a deeper call */
+static void __attribute__((noinline)) prefault_stack(size_t stack_bytes)
+{
+	volatile char *stack = alloca(stack_bytes);
+	size_t i;
+
+	for (i = 0; i < stack_bytes; i += 4096)
+		stack[i] = 0;
+}
+
+/* locks all pages mapped now and later into memory, which faults them in,
+   keeps malloc() from giving memory back or mapping new chunks and
+   prefaults stack_bytes of stack. Returns -1 if memory cannot be locked. */
+int harden_memory(size_t stack_bytes)
+{
+#if defined (HAVE_MALLOC_H) && defined (M_TRIM_THRESHOLD) && defined (M_MMAP_MAX)
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+
+#if defined (HAVE_MLOCKALL)
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		log_err("mlockall() failed");
+		return -1;
+	}
+
+	prefault_stack(stack_bytes);
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+#if defined (HAVE_SCHED_SETAFFINITY)
+/* the cpus left by harden_avoid() */
+static cpu_set_t others;
+#endif
+
+/* keeps the calling thread, and the threads and processes it creates
+   later, off cpu. Returns 1 if cpu is the only one it may run on, where
+   it stays, -1 on errors. */
+int harden_avoid(int cpu)
+{
+#if defined (HAVE_SCHED_SETAFFINITY)
+	if (sched_getaffinity(0, sizeof others, &others) < 0) {
+		log_err("sched_getaffinity() failed");
+		return -1;
+	}
+
+	CPU_CLR(cpu, &others);
+	if (CPU_COUNT(&others) == 0) {
+		CPU_SET(cpu, &others);
+		return 1;
+	}
+
+	if (sched_setaffinity(0, sizeof others, &others) < 0) {
+		log_err("sched_setaffinity() failed");
+		return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* pins the calling thread alone to cpu */
+int harden_pin(int cpu)
+{
+#if defined (HAVE_SCHED_SETAFFINITY)
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+
+	if (sched_setaffinity(0, sizeof set, &set) < 0) {
+		log_err("sched_setaffinity(%d) failed", cpu);
+		return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* moves the calling thread back to the cpus harden_avoid() left */
+int harden_unpin(void)
+{
+#if defined (HAVE_SCHED_SETAFFINITY)
+	if (sched_setaffinity(0, sizeof others, &others) < 0) {
+		log_err("sched_setaffinity() failed");
+		return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/* whether cpu is in a cpu list like "0-3,6,8-9" */
+static int cpulist_has(const char *list, int cpu)
+{
+	const char *p = list;
+
+	while (*p) {
+		char *end;
+		long lo = strtol(p, &end, 10), hi = lo;
+
+		if (end == p)
+			break;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		if (cpu >= lo && cpu <= hi)
+			return 1;
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+/* returns whether cpu is in the cpu list of given file, -1 if unknown */
+static int cpulist_file_has(const char *path, int cpu)
+{
+	char list[1024];
+	FILE *f = fopen(path, "r");
+	int r = -1;
+
+	if (!f)
+		return -1;
+
+	if (fgets(list, sizeof list, f))
+		r = cpulist_has(list, cpu);
+	else
+		r = 0;	/* empty, no cpu in it */
+
+	fclose(f);
+
+	return r;
+}
+
+/* returns whether cpu is kept free of other tasks with isolcpus, -1 if
+   unknown */
+int harden_cpu_isolated(int cpu)
+{
+	return cpulist_file_has("/sys/devices/system/cpu/isolated", cpu);
+}
+
+/* returns whether cpu runs without the scheduler tick, -1 if unknown */
+int harden_cpu_nohz(int cpu)
+{
+	return cpulist_file_has("/sys/devices/system/cpu/nohz_full", cpu);
+}
+
+/* names in /proc/interrupts of the drivers behind a port of given name */
+static const char *usb_drivers[] = { "hcd", "xhci", "ehci", "ohci", "uhci", "dwc", "usb", NULL };
+static const char *uart_drivers[] = { "serial", "uart", "UART", NULL };
+
+/* finds the interrupt lines of the driver behind port and whether they
+   may be handled on cpu. Returns their number, at most max, or -1 if
+   /proc/interrupts cannot be read. */
+int harden_port_irqs(const char *port, int cpu, harden_irq_t *irqs, int max)
+{
+	char path[PATH_MAX], line[4096];
+	const char **drivers;
+	const char *dev;
+	FILE *f;
+	int n = 0;
+
+	if (!realpath(port, path))
+		snprintf(path, sizeof path, "%s", port);
+
+	dev = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+
+	/* pseudo terminals have no interrupt */
+	if (strncmp(path, "/dev/pts/", 9) == 0)
+		return 0;
+
+	if (strncmp(dev, "ttyUSB", 6) == 0 || strncmp(dev, "ttyACM", 6) == 0)
+		drivers = usb_drivers;
+	else
+		drivers = uart_drivers;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return -1;
+
+	while (n < max && fgets(line, sizeof line, f)) {
+		char *name;
+		int irq, i, match = 0;
+
+		if (sscanf(line, " %d:", &irq) != 1)
+			continue;
+
+		line[strcspn(line, "\n")] = 0;
+		name = strrchr(line, ' ');
+		name = name ? name + 1 : line;
+
+		/* a UART usually carries the name of its tty */
+		if (drivers == uart_drivers && strcmp(name, dev) == 0)
+			match = 1;
+		for (i = 0; drivers[i] && !match; ++i)
+			if (strstr(name, drivers[i]))
+				match = 1;
+		if (!match)
+			continue;
+
+		irqs[n].irq = irq;
+		snprintf(irqs[n].name, sizeof irqs[n].name, "%.47s", name);
+
+		snprintf(path, sizeof path, "/proc/irq/%d/effective_affinity_list", irq);
+		irqs[n].on_cpu = cpulist_file_has(path, cpu);
+		if (irqs[n].on_cpu < 0) {
+			snprintf(path, sizeof path, "/proc/irq/%d/smp_affinity_list", irq);
+			irqs[n].on_cpu = cpulist_file_has(path, cpu);
+		}
+
+		n++;
+	}
+
+	fclose(f);
+
+	return n;
+}
@@ -0,0 +1,33 @@
+#ifndef HARDEN_H
+#define HARDEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stddef.h>
+
+/* an interrupt line of the driver behind a port */
+typedef struct {
+	int irq;
+	char name[48];		/* as in /proc/interrupts */
+	int on_cpu;		/* may be handled on the cpu checked */
+} harden_irq_t;
+
+	int harden_memory(size_t stack_bytes);
+	int harden_avoid(int cpu);
+	int harden_pin(int cpu);
+	int harden_unpin(void);
+	int harden_cpu_isolated(int cpu);
+	int harden_cpu_nohz(int cpu);
+	int harden_port_irqs(const char *port, int cpu, harden_irq_t *irqs, int max);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+#include "histogram.h"
+
+#include <string.h>
+#include <math.h>
+
+#define SUB_COUNT  (1 << HIST_SUB_BITS)
+#define HALF_COUNT (1 << (HIST_SUB_BITS - 1))
+
+void histogram_reset(histogram_t *h)
+{
+	memset(h, 0, sizeof *h);
+	h->min = UINT64_MAX;
+}
+
+static int msb(uint64_t v)
+{
+	return 63 - __builtin_clzll(v);
+}
+
+int histogram_bucket(uint64_t v)
+{
+	if (v < SUB_COUNT)
+		return v;
+
+	int shift = msb(v) - (HIST_SUB_BITS - 1);
+	int bucket = SUB_COUNT + (shift - 1) * HALF_COUNT + (int)(v >> shift) - HALF_COUNT;
+
+	return bucket < HIST_BUCKETS ? bucket : HIST_BUCKETS - 1;
+}
+
+uint64_t histogram_bucket_low(int bucket)
+{
+	if (bucket < SUB_COUNT)
+		return bucket;
+
+	int shift = (bucket - SUB_COUNT) / HALF_COUNT + 1;
+	uint64_t sub = (bucket - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+
+	return sub << shift;
+}
+
+/* highest value counted in the bucket */
+uint64_t histogram_bucket_high(int bucket)
+{
+	if (bucket == HIST_BUCKETS - 1)
+		return UINT64_MAX;
+
+	return histogram_bucket_low(bucket + 1) - 1;
+}
+
+void histogram_add(histogram_t *h, uint64_t v)
+{
+	double delta = (double)v - h->mean;
+
+	h->counts[histogram_bucket(v)]++;
+	h->total++;
+
+	if (v < h->min) h->min = v;
+	if (v > h->max) h->max = v;
+
+	/* Welford's online algorithm */
+	h->mean += delta / h->total;
+	h->m2 += delta * ((double)v - h->mean);
+}
+
+void histogram_merge(histogram_t *dst, const histogram_t *src)
+{
+	int i;
+
+	if (src->total == 0)
+		return;
+
+	for (i = 0; i < HIST_BUCKETS; ++i)
+		dst->counts[i] += src->counts[i];
+
+	/* Chan et al., parallel variance */
+	uint64_t n = dst->total + src->total;
+	double delta = src->mean - dst->mean;
+
+	dst->m2 += src->m2 + delta * delta * dst->total * src->total / n;
+	dst->mean += delta * src->total / n;
+	dst->total = n;
+
+	if (src->min < dst->min) dst->min = src->min;
+	if (src->max > dst->max) dst->max = src->max;
+}
+
+/* number of values counted in buckets starting in [lo, hi) */
+uint64_t histogram_count(const histogram_t *h, uint64_t lo, uint64_t hi)
+{
+	uint64_t n = 0;
+	int i;
+
+	for (i = histogram_bucket(lo); i < HIST_BUCKETS; ++i) {
+		uint64_t low = histogram_bucket_low(i);
+		if (low >= hi)
+			break;
+		if (low >= lo)
+			n += h->counts[i];
+	}
+
+	return n;
+}
+
+/* value of the rank-th smallest value (counting from 1) */
+uint64_t histogram_rank(const histogram_t *h, uint64_t rank)
+{
+	uint64_t seen = 0;
+	int i;
+
+	if (h->total == 0)
+		return 0;
+
+	if (rank < 1) rank = 1;
+	if (rank >= h->total) return h->max;
+
+	for (i = 0; i < HIST_BUCKETS; ++i) {
+		seen += h->counts[i];
+		if (seen >= rank) {
+			uint64_t v = histogram_bucket_high(i);
+			if (v > h->max) v = h->max;
+			if (v < h->min) v = h->min;
+			return v;
+		}
+	}
+
+	return h->max;
+}
+
+/* value below or at which p percent of all values are */
+uint64_t histogram_percentile(const histogram_t *h, double p)
+{
+	return histogram_rank(h, ceil(p / 100.0 * h->total));
+}
+
+double histogram_stddev(const histogram_t *h)
+{
+	if (h->total < 2)
+		return 0;
+
+	return sqrt(h->m2 / (h->total - 1));
+}
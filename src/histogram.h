@@ -0,0 +1,47 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "slprefix.h"
+
+/* Log-linear (HDR style) histogram of nanosecond values.
+ *
+ * Values below 2^HIST_SUB_BITS get a bucket of their own. Above that, every
+ * power of two is split into 2^(HIST_SUB_BITS-1) equally wide buckets, so
+ * a value is known to within 1/2^(HIST_SUB_BITS-1) (0.8%) of itself from
+ * nanoseconds up to 2^HIST_MAX_BITS ns (about 18 minutes). Larger values
+ * are counted in the last bucket, min and max are always exact.
+ */
+#define HIST_SUB_BITS  8
+#define HIST_MAX_BITS  40
+#define HIST_BUCKETS   ((1 << HIST_SUB_BITS) + \
+                        (HIST_MAX_BITS - HIST_SUB_BITS) * (1 << (HIST_SUB_BITS - 1)))
+
+typedef struct {
+	uint64_t counts[HIST_BUCKETS];
+	uint64_t total;
+	uint64_t min, max;
+	double mean, m2;	/* running mean and sum of squared deviations */
+} histogram_t;
+
+	void     histogram_reset(histogram_t *h);
+	void     histogram_add(histogram_t *h, uint64_t v);
+	void     histogram_merge(histogram_t *dst, const histogram_t *src);
+	int      histogram_bucket(uint64_t v);
+	uint64_t histogram_bucket_low(int bucket);
+	uint64_t histogram_bucket_high(int bucket);
+	uint64_t histogram_count(const histogram_t *h, uint64_t lo, uint64_t hi);
+	uint64_t histogram_rank(const histogram_t *h, uint64_t rank);
+	uint64_t histogram_percentile(const histogram_t *h, double p);
+	double   histogram_stddev(const histogram_t *h);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
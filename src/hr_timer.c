@@ -0,0 +1,129 @@
+#include "hr_timer.h"
+
+#include <stdio.h>
+#include <string.h>
+#if defined(HR_TIMER_TSC)
+#include <cpuid.h>
+#endif
+
+static int initialized;
+
+/* whether hr_timer_init() was called, for code that may run before it */
+int hr_timer_initialized(void)
+{
+	return initialized;
+}
+
+#if defined(USING_LINUX)
+
+int      hr_timer_tsc;
+uint64_t hr_timer_mult;
+
+/* the external definitions of the inline functions */
+extern inline uint64_t hr_timer_clock_ns(void);
+extern inline void     GetHighResolutionTime(timerStruct *t);
+extern inline int64_t  ConvertTimeDifferenceToNs(timerStruct *end, timerStruct *begin);
+extern inline double   ConvertTimeDifferenceToSec(timerStruct *end, timerStruct *begin);
+#if defined(HR_TIMER_TSC)
+extern inline uint64_t hr_timer_rdtsc(void);
+
+/* The TSC is usable if it ticks at a constant rate in all power states
+   (invariant TSC) and the kernel has not found it to be unstable, e.g.
+   out of sync between sockets, in which case it drops it from the
+   available clock sources. */
+static int tsc_is_stable(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	char buf[256];
+	FILE *f;
+
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1 << 8)))
+		return 0;
+
+	f = fopen("/sys/devices/system/clocksource/clocksource0/available_clocksource", "r");
+	if (!f)
+		return 1;
+
+	if (!fgets(buf, sizeof buf, f))
+		buf[0] = 0;
+	fclose(f);
+
+	return strstr(buf, "tsc") != NULL;
+}
+
+/* reads the TSC and the clock as close together as possible */
+static void tsc_pair(uint64_t *tsc, uint64_t *ns)
+{
+	uint64_t best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < 16; ++i) {
+		uint64_t t0 = hr_timer_rdtsc();
+		uint64_t n = hr_timer_clock_ns();
+		uint64_t t1 = hr_timer_rdtsc();
+
+		if (t1 - t0 < best) {
+			best = t1 - t0;
+			*tsc = t0 + (t1 - t0) / 2;
+			*ns = n;
+		}
+	}
+}
+
+/* measures the TSC frequency against the clock over 50 ms */
+static void tsc_calibrate(void)
+{
+	uint64_t tsc0, ns0, tsc1, ns1;
+	struct timespec d = { 0, 50000000 };
+
+	tsc_pair(&tsc0, &ns0);
+	while (nanosleep(&d, &d) != 0);
+	tsc_pair(&tsc1, &ns1);
+
+	hr_timer_mult = (((ns1 - ns0) << HR_TIMER_SHIFT) + (tsc1 - tsc0) / 2) / (tsc1 - tsc0);
+}
+#endif
+
+const char *hr_timer_init(int use_tsc)
+{
+	static char name[64];
+
+	initialized = 1;
+	hr_timer_tsc = 0;
+	snprintf(name, sizeof name, "clock_gettime()");
+
+#if defined(HR_TIMER_TSC)
+	if (use_tsc && tsc_is_stable()) {
+		tsc_calibrate();
+		hr_timer_tsc = 1;
+		snprintf(name, sizeof name, "TSC at %.3f GHz",
+		         (double)(1 << HR_TIMER_SHIFT) / hr_timer_mult);
+	}
+#endif
+
+	return name;
+}
+
+#else
+
+const char *hr_timer_init(int use_tsc)
+{
+	initialized = 1;
+	return "the system's high resolution timer";
+}
+
+#endif
+
+/* average time it takes to take one time stamp */
+double hr_timer_cost_ns(void)
+{
+	timerStruct begin, end, t;
+	int i;
+
+	GetHighResolutionTime(&begin);
+	for (i = 0; i < 100000; ++i)
+		GetHighResolutionTime(&t);
+	GetHighResolutionTime(&end);
+
+	return ConvertTimeDifferenceToNs(&end, &begin) / 100000.0;
+}
@@ -3,6 +3,17 @@
 
 #include "config.h"
 
+#include <stdint.h>
+
+#include "slprefix.h"
+
+/* Call hr_timer_init() once before taking any time stamps. It picks the
+   clock (the TSC where that is possible and use_tsc is set), calibrates
+   it and returns the name of the clock for the log. */
+	const char *hr_timer_init(int use_tsc);
+	int         hr_timer_initialized(void);
+	double      hr_timer_cost_ns(void);
+
 #if defined(WIN32) && defined(_MSC_VER)
 	#define USING_MSVC 
 #endif
@@ -37,6 +48,15 @@
 		return (end->QuadPart - begin->QuadPart) / (double)freq.QuadPart;
 	}
 
+	inline int64_t ConvertTimeDifferenceToNs(timerStruct *end, timerStruct *begin) {
+		timerStruct freq;
+		int64_t d = end->QuadPart - begin->QuadPart;
+
+		QueryPerformanceFrequency(&freq);
+
+		return d / freq.QuadPart * 1000000000 + d % freq.QuadPart * 1000000000 / freq.QuadPart;
+	}
+
 #elif defined(USING_MINGW)
 
 	#include <windows.h>
@@ -54,31 +74,80 @@
 		return (end->QuadPart - begin->QuadPart) / (double)freq.QuadPart;
 	}
 
+	inline int64_t ConvertTimeDifferenceToNs(timerStruct *end, timerStruct *begin) {
+		timerStruct freq;
+		int64_t d = end->QuadPart - begin->QuadPart;
+
+		QueryPerformanceFrequency(&freq);
+
+		return d / freq.QuadPart * 1000000000 + d % freq.QuadPart * 1000000000 / freq.QuadPart;
+	}
+
 #elif defined(USING_LINUX)  // Assume we have POSIX calls clock_gettime() 
 	#include <time.h>
-	typedef struct timespec timerStruct;
 
-    inline void GetHighResolutionTime(timerStruct *t) {
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+	#define HR_TIMER_TSC
+	#include <x86intrin.h>
+#endif
+
+	/* nanoseconds of the clock, or TSC ticks if hr_timer_tsc is set */
+	typedef uint64_t timerStruct;
+
+	extern int      hr_timer_tsc;
+	extern uint64_t hr_timer_mult;	/* ns per tick << HR_TIMER_SHIFT */
+
+	#define HR_TIMER_SHIFT 24
+
+	inline uint64_t hr_timer_clock_ns(void) {
+		struct timespec ts;
 #if defined(CLOCK_MONOTONIC_RAW)
-		clock_gettime(CLOCK_MONOTONIC_RAW, t);
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
 #else
-		clock_gettime(CLOCK_MONOTONIC, t);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
 #endif
+		return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 	}
 
-	inline double ConvertTimeDifferenceToSec(timerStruct *end, timerStruct *begin) {
+#if defined(HR_TIMER_TSC)
+	/* the fences keep the read from moving across the code it times */
+	inline uint64_t hr_timer_rdtsc(void) {
+		uint64_t t;
+		_mm_lfence();
+		t = __rdtsc();
+		_mm_lfence();
+		return t;
+	}
+#endif
+
+    inline void GetHighResolutionTime(timerStruct *t) {
+#if defined(HR_TIMER_TSC)
+		if (hr_timer_tsc) {
+			*t = hr_timer_rdtsc();
+			return;
+		}
+#endif
+		*t = hr_timer_clock_ns();
+	}
 
-		timerStruct temp;
+	inline int64_t ConvertTimeDifferenceToNs(timerStruct *end, timerStruct *begin) {
+		uint64_t d;
 
-		if ((end->tv_nsec-begin->tv_nsec)<0) {
-			temp.tv_sec = end->tv_sec-begin->tv_sec-1;
-			temp.tv_nsec = 1000000000+end->tv_nsec-begin->tv_nsec;
-		} else {
-			temp.tv_sec = end->tv_sec-begin->tv_sec;
-			temp.tv_nsec = end->tv_nsec-begin->tv_nsec;
+		if (!hr_timer_tsc)
+			return (int64_t)(*end - *begin);
+
+		/* split so that the product never overflows */
+		if (*end >= *begin) {
+			d = *end - *begin;
+			return (int64_t)((d >> HR_TIMER_SHIFT) * hr_timer_mult +
+			                 (((d & ((1 << HR_TIMER_SHIFT) - 1)) * hr_timer_mult) >> HR_TIMER_SHIFT));
 		}
 
-		return (temp.tv_sec) + (1e-9)*(temp.tv_nsec); 
+		return -ConvertTimeDifferenceToNs(begin, end);
+	}
+
+	inline double ConvertTimeDifferenceToSec(timerStruct *end, timerStruct *begin) {
+		return ConvertTimeDifferenceToNs(end, begin) * 1e-9;
 	}
 
 #elif defined(USING_MACOSX)  // Assume we're running on MacOS X
@@ -105,6 +174,14 @@
 
 		return double(*(uint64_t*)&elapsedNano) * (1e-9);
 	}
+
+	inline int64_t ConvertTimeDifferenceToNs(timerStruct *end, timerStruct *begin) {
+		uint64_t elapsed = *end - *begin;
+
+		Nanoseconds elapsedNano = AbsoluteToNanoseconds(*(AbsoluteTime*)&elapsed);
+
+		return *(uint64_t*)&elapsedNano;
+	}
 #endif
 
 #endif // end #ifndef HR_TIMER_H
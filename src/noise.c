@@ -0,0 +1,152 @@
+#include "noise.h"
+#include "harden.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/* opens the interrupt counters of port and picks the rusage of the
+   calling thread if per_thread is set and the system has it, else of the
+   process. Returns the number of interrupt lines watched. */
+int noise_init(noise_t *n, const char *port, int per_thread)
+{
+	harden_irq_t irqs[NOISE_MAX_IRQS];
+	int nr = harden_port_irqs(port, 0, irqs, NOISE_MAX_IRQS);
+	int i;
+
+	memset(n, 0, sizeof *n);
+
+#if defined (RUSAGE_THREAD)
+	n->who = per_thread ? RUSAGE_THREAD : RUSAGE_SELF;
+#else
+	n->who = RUSAGE_SELF;
+#endif
+
+	for (i = 0; i < nr; ++i) {
+		char path[64];
+		int fd;
+
+		snprintf(path, sizeof path, "/sys/kernel/irq/%d/per_cpu_count", irqs[i].irq);
+		fd = open(path, O_RDONLY);
+		if (fd >= 0)
+			n->fds[n->nr_fds++] = fd;
+	}
+
+	return n->nr_fds;
+}
+
+void noise_free(noise_t *n)
+{
+	int i;
+
+	for (i = 0; i < n->nr_fds; ++i)
+		close(n->fds[i]);
+	n->nr_fds = 0;
+}
+
+/* sums a line of comma separated counts */
+static uint64_t sum_counts(const char *p)
+{
+	uint64_t sum = 0;
+
+	while (*p) {
+		char *end;
+		unsigned long long v = strtoull(p, &end, 10);
+
+		if (end == p)
+			break;
+		sum += v;
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	return sum;
+}
+
+/* takes a snapshot: one getrusage() and one pread() per interrupt line */
+void noise_take(const noise_t *n, noise_snap_t *s)
+{
+	struct rusage ru;
+	char buf[1024];
+	int i;
+
+	getrusage(n->who, &ru);
+
+	s->vcsw = ru.ru_nvcsw;
+	s->ivcsw = ru.ru_nivcsw;
+	s->minflt = ru.ru_minflt;
+	s->majflt = ru.ru_majflt;
+	s->irqs = 0;
+
+	for (i = 0; i < n->nr_fds; ++i) {
+		ssize_t len = pread(n->fds[i], buf, sizeof buf - 1, 0);
+
+		if (len > 0) {
+			buf[len] = 0;
+			s->irqs += sum_counts(buf);
+		}
+	}
+}
+
+void noise_delta(noise_delta_t *d, const noise_snap_t *before, const noise_snap_t *after)
+{
+	d->vcsw = after->vcsw - before->vcsw;
+	d->ivcsw = after->ivcsw - before->ivcsw;
+	d->minflt = after->minflt - before->minflt;
+	d->majflt = after->majflt - before->majflt;
+	d->irqs = after->irqs - before->irqs;
+}
+
+/* Voluntary context switches are the tester waiting for the reply and
+   the port's interrupts are the reply arriving, both are part of every
+   sample. Being preempted or faulting is the host getting in the way. */
+int noise_disturbed(const noise_delta_t *d)
+{
+	return d->ivcsw || d->minflt || d->majflt;
+}
+
+void noise_stats_reset(noise_stats_t *ns)
+{
+	memset(ns, 0, sizeof *ns);
+	histogram_reset(&ns->clean);
+	histogram_reset(&ns->disturbed);
+}
+
+void noise_stats_add(noise_stats_t *ns, uint64_t latency, const noise_delta_t *d)
+{
+	if (noise_disturbed(d)) {
+		histogram_add(&ns->disturbed, latency);
+		ns->irqs_disturbed += d->irqs;
+	} else {
+		histogram_add(&ns->clean, latency);
+		ns->irqs_clean += d->irqs;
+	}
+
+	ns->ivcsw += d->ivcsw > 0;
+	ns->minflt += d->minflt > 0;
+	ns->majflt += d->majflt > 0;
+
+	if (latency >= ns->worst_ns) {
+		ns->worst_ns = latency;
+		ns->worst = *d;
+	}
+}
+
+void noise_stats_merge(noise_stats_t *dst, const noise_stats_t *src)
+{
+	histogram_merge(&dst->clean, &src->clean);
+	histogram_merge(&dst->disturbed, &src->disturbed);
+	dst->ivcsw += src->ivcsw;
+	dst->minflt += src->minflt;
+	dst->majflt += src->majflt;
+	dst->irqs_clean += src->irqs_clean;
+	dst->irqs_disturbed += src->irqs_disturbed;
+
+	if (src->worst_ns >= dst->worst_ns) {
+		dst->worst_ns = src->worst_ns;
+		dst->worst = src->worst;
+	}
+}
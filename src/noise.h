@@ -0,0 +1,59 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/* interrupt lines of a port watched at most */
+#define NOISE_MAX_IRQS 8
+
+/* what the host did to the tester, as counters */
+typedef struct {
+	long vcsw, ivcsw;	/* voluntary and involuntary context switches */
+	long minflt, majflt;	/* page faults */
+	uint64_t irqs;		/* interrupts of the port */
+} noise_snap_t;
+
+/* the difference of two snapshots around one sample */
+typedef struct {
+	uint32_t vcsw, ivcsw, minflt, majflt, irqs;
+} noise_delta_t;
+
+typedef struct {
+	int who;		/* RUSAGE_THREAD or RUSAGE_SELF */
+	int fds[NOISE_MAX_IRQS];	/* /sys/kernel/irq/<n>/per_cpu_count */
+	int nr_fds;
+} noise_t;
+
+/* latencies split by whether the host disturbed the tester during them */
+typedef struct {
+	histogram_t clean, disturbed;
+	uint64_t ivcsw, minflt, majflt;	/* samples with any of them */
+	uint64_t irqs_clean, irqs_disturbed;
+	uint64_t worst_ns;
+	noise_delta_t worst;	/* of the sample with the worst latency */
+} noise_stats_t;
+
+	int  noise_init(noise_t *n, const char *port, int per_thread);
+	void noise_free(noise_t *n);
+	void noise_take(const noise_t *n, noise_snap_t *s);
+	void noise_delta(noise_delta_t *d, const noise_snap_t *before, const noise_snap_t *after);
+	int  noise_disturbed(const noise_delta_t *d);
+	void noise_stats_reset(noise_stats_t *ns);
+	void noise_stats_add(noise_stats_t *ns, uint64_t latency, const noise_delta_t *d);
+	void noise_stats_merge(noise_stats_t *dst, const noise_stats_t *src);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+#include "pace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#if !defined (_WIN32)
+#include <unistd.h>
+#endif
+
+static const char *pace_names[PACE_COUNT] = { "fixed", "uniform", "exp" };
+
+/* returns the PACE_* distribution of given name, or -1 */
+int pace_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < PACE_COUNT; ++i)
+		if (strcmp(name, pace_names[i]) == 0)
+			return i;
+
+	return -1;
+}
+
+const char *pace_name(int dist)
+{
+	return pace_names[dist];
+}
+
+/* splitmix64, spreads any seed over the whole state of the generator */
+static uint64_t mix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/* xorshift64*, uniform in [0, 1) */
+double pace_random(pace_t *p)
+{
+	p->rng ^= p->rng >> 12;
+	p->rng ^= p->rng << 25;
+	p->rng ^= p->rng >> 27;
+
+	return ((p->rng * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void pace_init(pace_t *p, int dist, double gap_ns, uint64_t spin_ns, uint64_t seed)
+{
+	p->dist = dist;
+	p->gap_ns = gap_ns;
+	p->spin_ns = spin_ns;
+	p->seed = seed;
+	p->rng = mix(seed);
+	if (p->rng == 0)
+		p->rng = 1;
+	histogram_reset(&p->err);
+}
+
+/* a seed that differs from run to run */
+uint64_t pace_seed(void)
+{
+	uint64_t seed = 0;
+#if !defined (_WIN32)
+	FILE *f = fopen("/dev/urandom", "rb");
+
+	if (f) {
+		if (fread(&seed, sizeof seed, 1, f) != 1)
+			seed = 0;
+		fclose(f);
+	}
+
+	seed ^= (uint64_t)getpid() << 32;
+#endif
+	return seed ^ (uint64_t)time(NULL);
+}
+
+/* the next gap between two sends in ns */
+uint64_t pace_gap(pace_t *p)
+{
+	switch (p->dist) {
+	case PACE_UNIFORM:
+		return p->gap_ns * (1 + pace_random(p));
+	case PACE_EXP:
+		return -p->gap_ns * log(1 - pace_random(p));
+	default:
+		return p->gap_ns;
+	}
+}
+
+#if defined (HAVE_CLOCK_NANOSLEEP)
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* sleeps until CLOCK_MONOTONIC reaches abs_ns, unless stop is set */
+static void sleep_until(uint64_t abs_ns, volatile sig_atomic_t *stop)
+{
+	struct timespec ts;
+
+	ts.tv_sec = abs_ns / 1000000000;
+	ts.tv_nsec = abs_ns % 1000000000;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !*stop);
+}
+#endif
+
+/* sleeps for ns, on an absolute deadline where there is one, so signals
+   do not stretch the sleep, unless stop is set */
+void pace_sleep(uint64_t ns, volatile sig_atomic_t *stop)
+{
+#if defined (HAVE_CLOCK_NANOSLEEP)
+	sleep_until(monotonic_ns() + ns, stop);
+#elif defined (_WIN32)
+	Sleep(ns / 1000000);
+#else
+	struct timespec ts;
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR && !*stop);
+#endif
+}
+
+/* ties base to CLOCK_MONOTONIC, once per run, so pace_wait() sleeps
+   until deadlines taken from the schedule instead of from the time it
+   was called */
+void pace_anchor(pace_t *p, timerStruct *base)
+{
+#if defined (HAVE_CLOCK_NANOSLEEP)
+	timerStruct now;
+	uint64_t mono = monotonic_ns();
+
+	GetHighResolutionTime(&now);
+	p->anchor_ns = mono - ConvertTimeDifferenceToNs(&now, base);
+#else
+	(void)base;
+	p->anchor_ns = 0;
+#endif
+}
+
+/* sleeps until spin_ns before due_ns after base, the anchor of
+   pace_anchor(), on an absolute deadline, so the time spent getting here
+   and earlier late wake ups do not add up, busy waits the rest of the
+   way on the clock of the time stamps and records how late it returned,
+   unless stop was set */
+void pace_wait(pace_t *p, timerStruct *base, uint64_t due_ns, volatile sig_atomic_t *stop)
+{
+	timerStruct now;
+	int64_t left;
+
+	GetHighResolutionTime(&now);
+	left = (int64_t)due_ns - ConvertTimeDifferenceToNs(&now, base);
+
+	if (left > (int64_t)p->spin_ns) {
+#if defined (HAVE_CLOCK_NANOSLEEP)
+		sleep_until(p->anchor_ns + due_ns - p->spin_ns, stop);
+#else
+		pace_sleep(left - p->spin_ns, stop);
+#endif
+	}
+
+	do {
+		GetHighResolutionTime(&now);
+		left = (int64_t)due_ns - ConvertTimeDifferenceToNs(&now, base);
+	} while (left > 0 && !*stop);
+
+	/* a wait cut short by stop never reached its deadline */
+	if (left <= 0)
+		histogram_add(&p->err, -left);
+}
@@ -0,0 +1,46 @@
+#ifndef PACE_H
+#define PACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <signal.h>
+
+#include "hr_timer.h"
+#include "histogram.h"
+
+/* distribution of the gaps between sends */
+enum {
+	PACE_FIXED,		/* always gap_ns */
+	PACE_UNIFORM,		/* uniform between gap_ns and twice that */
+	PACE_EXP,		/* exponential with mean gap_ns, i.e. Poisson sends */
+	PACE_COUNT
+};
+
+typedef struct {
+	int dist;
+	double gap_ns;
+	uint64_t spin_ns;	/* busy wait the last spin_ns before a deadline */
+	uint64_t seed;
+	uint64_t rng;		/* xorshift64* state */
+	histogram_t err;	/* how late the deadlines were met, in ns */
+	uint64_t anchor_ns;	/* CLOCK_MONOTONIC at the base of pace_wait() */
+} pace_t;
+
+	int      pace_parse(const char *name);
+	const char *pace_name(int dist);
+	void     pace_init(pace_t *p, int dist, double gap_ns, uint64_t spin_ns, uint64_t seed);
+	uint64_t pace_seed(void);
+	double   pace_random(pace_t *p);
+	uint64_t pace_gap(pace_t *p);
+	void     pace_sleep(uint64_t ns, volatile sig_atomic_t *stop);
+	void     pace_anchor(pace_t *p, timerStruct *base);
+	void     pace_wait(pace_t *p, timerStruct *base, uint64_t due_ns, volatile sig_atomic_t *stop);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
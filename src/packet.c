@@ -0,0 +1,81 @@
+#include "packet.h"
+
+static void put_le(uint8_t *buf, uint64_t v, int n)
+{
+	int i;
+	for (i = 0; i < n; ++i) {
+		buf[i] = v & 0xff;
+		v >>= 8;
+	}
+}
+
+static uint64_t get_le(const uint8_t *buf, int n)
+{
+	uint64_t v = 0;
+	int i;
+	for (i = n - 1; i >= 0; --i) {
+		v = (v << 8) | buf[i];
+	}
+	return v;
+}
+
+uint16_t packet_crc16(const uint8_t *buf, size_t len)
+{
+	uint16_t crc = 0xffff;
+	size_t i;
+	int j;
+
+	for (i = 0; i < len; ++i) {
+		crc ^= (uint16_t)buf[i] << 8;
+		for (j = 0; j < 8; ++j) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+
+	return crc;
+}
+
+/* fills buf with a complete frame of len >= PACKET_MIN_LEN bytes */
+void packet_encode(uint8_t *buf, size_t len, uint32_t seq, uint64_t ts)
+{
+	size_t i;
+
+	buf[0] = PACKET_SYNC;
+	put_le(buf + 1, seq, 4);
+	put_le(buf + 5, ts, 8);
+	put_le(buf + 13, 0, 4);
+
+	for (i = PACKET_HDR_LEN; i < len - PACKET_CRC_LEN; ++i) {
+		buf[i] = i % 255;
+	}
+
+	put_le(buf + len - PACKET_CRC_LEN, packet_crc16(buf, len - PACKET_CRC_LEN), 2);
+}
+
+/* returns 0 if buf holds a valid frame of len bytes, -1 otherwise */
+int packet_decode(const uint8_t *buf, size_t len, uint32_t *seq, uint64_t *ts)
+{
+	if (len < PACKET_MIN_LEN || buf[0] != PACKET_SYNC)
+		return -1;
+
+	if (get_le(buf + len - PACKET_CRC_LEN, 2) != packet_crc16(buf, len - PACKET_CRC_LEN))
+		return -1;
+
+	*seq = get_le(buf + 1, 4);
+	*ts  = get_le(buf + 5, 8);
+
+	return 0;
+}
+
+/* returns the turnaround time a responder put into a valid frame */
+uint32_t packet_turnaround(const uint8_t *buf)
+{
+	return get_le(buf + 13, 4);
+}
+
+/* puts the turnaround time into a valid frame of len bytes */
+void packet_set_turnaround(uint8_t *buf, size_t len, uint64_t ns)
+{
+	put_le(buf + 13, ns < UINT32_MAX ? ns : UINT32_MAX, 4);
+	put_le(buf + len - PACKET_CRC_LEN, packet_crc16(buf, len - PACKET_CRC_LEN), 2);
+}
@@ -0,0 +1,38 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "slprefix.h"
+
+/* Framed packet layout, all fields little endian:
+ *
+ *   offset  size  field
+ *        0     1  PACKET_SYNC
+ *        1     4  sequence number
+ *        5     8  send timestamp [ns]
+ *       13     4  turnaround [ns] of an --echo=stamp responder, else 0
+ *       17     n  payload (filler pattern)
+ *     17+n     2  CRC-16/CCITT over all preceding bytes
+ */
+#define PACKET_SYNC     0xA5
+#define PACKET_HDR_LEN  17
+#define PACKET_CRC_LEN  2
+#define PACKET_MIN_LEN  (PACKET_HDR_LEN + PACKET_CRC_LEN)
+
+	uint16_t packet_crc16(const uint8_t *buf, size_t len);
+	void     packet_encode(uint8_t *buf, size_t len, uint32_t seq, uint64_t ts);
+	int      packet_decode(const uint8_t *buf, size_t len, uint32_t *seq, uint64_t *ts);
+	uint32_t packet_turnaround(const uint8_t *buf);
+	void     packet_set_turnaround(uint8_t *buf, size_t len, uint64_t ns);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+#include "probe.h"
+#include "packet.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* prepares p for packets of len bytes over fd, returns -1 if out of memory */
+int probe_init(probe_t *p, PORTTYPE fd, serial_wait_t *w, int len, int framed)
+{
+	int i;
+
+	memset(p, 0, sizeof *p);
+
+	p->fd = fd;
+	p->wait = w;
+	p->len = len;
+	p->framed = framed;
+	p->tx = calloc(len + 1, 1);
+	p->rx = calloc(len + 1, 1);
+
+	if (!p->tx || !p->rx) {
+		probe_free(p);
+		return -1;
+	}
+
+	for (i = 0; i < len; ++i)
+		p->tx[i] = i % 255;
+
+	return 0;
+}
+
+void probe_free(probe_t *p)
+{
+	free(p->tx);
+	free(p->rx);
+	p->tx = p->rx = NULL;
+}
+
+/* prepares packet seq sent at ts for probe_send() */
+void probe_stamp(probe_t *p, uint32_t seq, uint64_t ts)
+{
+	if (p->framed)
+		packet_encode(p->tx, p->len, seq, ts);
+	else
+		p->tx[0] = seq & 0xff;
+}
+
+/* returns the bytes written, len unless the port failed */
+ssize_t probe_send(probe_t *p)
+{
+	return serial_write(p->fd, p->tx, p->len);
+}
+
+/* reads up to len bytes like serial_read_wait(). With gap, it times every
+   read() and counts the gaps between the bytes of a reply; bytes that
+   came with the same read() have a gap of 0. */
+static int read_timed(probe_t *p, uint8_t *buf, int len, int have)
+{
+	timerStruct now, last = p->first;
+	int count = 0, i;
+
+	if (!p->gap)
+		return serial_read_wait(p->fd, p->wait, buf, len);
+
+	while (count < len) {
+		int n = serial_read_any(p->fd, p->wait, buf + count, len - count);
+
+		if (n <= 0)
+			return n < 0 ? n : count;
+
+		GetHighResolutionTime(&now);
+
+		if (have + count == 0)
+			p->first = now;
+		else
+			histogram_add(p->gap, ConvertTimeDifferenceToNs(&now, &last));
+
+		for (i = 1; i < n; ++i)
+			histogram_add(p->gap, 0);
+
+		last = now;
+		count += n;
+	}
+
+	return count;
+}
+
+/* reads the next reply into rx. A framed one yields its sequence number
+   in *seq, invalid frames are counted in *corrupt and the stream is
+   resynchronised on the next sync byte. An unframed one has to carry the
+   tag of expect, which goes to *seq. */
+int probe_recv(probe_t *p, uint32_t expect, uint32_t *seq, unsigned long *corrupt)
+{
+	int len = p->len, have = 0;
+
+	for (;;) {
+		int n = read_timed(p, p->rx + have, len - have, have);
+		uint64_t ts;
+		int i;
+
+		if (n < 0)
+			return PROBE_ERROR;
+
+		have += n;
+
+		if (have < len)
+			return PROBE_TIMEOUT;
+
+		if (!p->framed) {
+			*seq = expect;
+			return p->rx[0] == (expect & 0xff) ? PROBE_OK : PROBE_CORRUPT;
+		}
+
+		if (packet_decode(p->rx, len, seq, &ts) == 0)
+			return PROBE_OK;
+
+		(*corrupt)++;
+
+		for (i = 1; i < len && p->rx[i] != PACKET_SYNC; ++i);
+		have = len - i;
+		memmove(p->rx, p->rx + i, have);
+	}
+}
+
+/* what an --echo=stamp responder put into the last framed reply, in ns */
+uint32_t probe_turnaround(const probe_t *p)
+{
+	return p->framed ? packet_turnaround(p->rx) : 0;
+}
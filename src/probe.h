@@ -0,0 +1,55 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stdint.h>
+
+#include "slprefix.h"
+
+#include "serial.h"
+#include "histogram.h"
+#include "hr_timer.h"
+
+/* result of probe_recv() */
+enum {
+	PROBE_OK,
+	PROBE_TIMEOUT,		/* no more bytes came for wait->timeout_ms */
+	PROBE_ERROR,
+	PROBE_CORRUPT,		/* an unframed reply with the wrong tag */
+};
+
+/* One roundtrip over a port, the packet going out and its reply coming
+ * back, as the tester and libseriallatency both take them. Unframed
+ * packets are tagged with the low byte of their sequence number in the
+ * first byte. Sending only touches tx and receiving everything else, so
+ * the two may run in different threads.
+ */
+typedef struct {
+	PORTTYPE fd;
+	serial_wait_t *wait;
+	int len;		/* bytes per packet */
+	int framed;		/* sequence numbered, checksummed packets */
+	uint8_t *tx, *rx;
+	histogram_t *gap;	/* gaps between the bytes of a reply, or NULL */
+	timerStruct first;	/* the first byte of the last reply, with gap only */
+} probe_t;
+
+	int      probe_init(probe_t *p, PORTTYPE fd, serial_wait_t *w, int len, int framed);
+	void     probe_free(probe_t *p);
+	void     probe_stamp(probe_t *p, uint32_t seq, uint64_t ts);
+	ssize_t  probe_send(probe_t *p);
+	int      probe_recv(probe_t *p, uint32_t expect, uint32_t *seq, unsigned long *corrupt);
+	uint32_t probe_turnaround(const probe_t *p);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+#include "report.h"
+
+#include <stdio.h>
+
+#define TERMWIDTH 50
+
+static int digits(double number)
+{
+	int digits = 1, pten = 10;
+
+	while (pten <= number) {
+		digits++; pten *= 10;
+	}
+
+	return digits;
+}
+
+/* lower edge of the k-th row of the printed distribution, the rows split
+   every power of two in half: 2, 3, 4, 6, 8, 12, 16, .. ns */
+static uint64_t row_edge(int k)
+{
+	return (k & 1) ? (uint64_t)3 << (k / 2 - 1) : (uint64_t)1 << (k / 2);
+}
+
+/* prints an ASCII bar chart of h in ms */
+void report_distribution(const histogram_t *h)
+{
+	int first = 2, last, k, j;
+	uint64_t binlevel = 0;
+
+	if (h->total == 0)
+		return;
+
+	while (row_edge(first + 1) <= h->min) first++;
+	for (last = first; row_edge(last + 1) <= h->max && last < 2 * HIST_MAX_BITS; last++);
+
+	for (k = first; k <= last; ++k) {
+		uint64_t n = histogram_count(h, k == first ? 0 : row_edge(k), row_edge(k + 1));
+		if (n > binlevel) binlevel = n;
+	}
+
+	int dig = digits(h->max / 1e6); char fmt[256];
+	snprintf(fmt, sizeof(fmt), " %%%d.3f .. %%%d.3f [ms]: %%%dlu ", dig + 4, dig + 4, digits(h->total));
+
+	for (k = first; k <= last; ++k) {
+		uint64_t n = histogram_count(h, k == first ? 0 : row_edge(k), row_edge(k + 1));
+		printf(fmt, row_edge(k) / 1e6, row_edge(k + 1) / 1e6, (unsigned long)n);
+		int bar_width = (n * TERMWIDTH) / binlevel;
+		if (bar_width == 0 && n > 0) bar_width = 1;
+		for (j = 0; j < bar_width; ++j) printf("#");
+		printf("\n");
+	}
+}
+
+void report_latency(const histogram_t *h)
+{
+	printf(" best    latency was %.2f ms\n", h->min / 1e6);
+	printf(" worst   latency was %.2f ms\n", h->max / 1e6);
+	printf(" average latency was %.2f ms\n", h->mean / 1e6);
+}
+
+static void percentile_header(void)
+{
+	printf("       p50       p90       p99     p99.9    p99.99       max    stddev\n");
+}
+
+static void percentile_row(const histogram_t *h)
+{
+	printf(" %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+	       histogram_percentile(h, 50) / 1e6,
+	       histogram_percentile(h, 90) / 1e6,
+	       histogram_percentile(h, 99) / 1e6,
+	       histogram_percentile(h, 99.9) / 1e6,
+	       histogram_percentile(h, 99.99) / 1e6,
+	       h->max / 1e6,
+	       histogram_stddev(h) / 1e6);
+}
+
+void report_percentiles(const histogram_t *h)
+{
+	percentile_header();
+	percentile_row(h);
+}
+
+/* prints the percentiles of h as overhead over the time the data takes on
+   the wire, absolute and as a multiple of it */
+void report_overhead(const histogram_t *h, uint64_t wire_ns)
+{
+	static const double ps[] = { 50, 90, 99, 99.9, 99.99 };
+	double v[7];
+	int i;
+
+	for (i = 0; i < 5; ++i)
+		v[i] = histogram_percentile(h, ps[i]);
+	v[5] = h->max;
+	v[6] = h->mean;
+
+	printf("%-12s       p50       p90       p99     p99.9    p99.99       max       avg\n", "");
+
+	printf("%-12s", "latency");
+	for (i = 0; i < 7; ++i)
+		printf(" %9.3f", v[i] / 1e6);
+	printf("\n");
+
+	printf("%-12s", "overhead");
+	for (i = 0; i < 7; ++i)
+		printf(" %9.3f", (v[i] - wire_ns) / 1e6);
+	printf("\n");
+
+	printf("%-12s", "ratio");
+	for (i = 0; i < 7; ++i)
+		printf(" %8.2fx", v[i] / wire_ns);
+	printf("\n");
+}
+
+/* prints the percentiles of several distributions, one named row each */
+void report_percentiles_named(const char *const *names, const histogram_t *const *h, int n)
+{
+	int i;
+
+	printf("%-12s", "");
+	percentile_header();
+
+	for (i = 0; i < n; ++i) {
+		printf("%-12s", names[i]);
+		percentile_row(h[i]);
+	}
+}
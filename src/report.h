@@ -0,0 +1,20 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "histogram.h"
+
+	void report_distribution(const histogram_t *h);
+	void report_latency(const histogram_t *h);
+	void report_percentiles(const histogram_t *h);
+	void report_overhead(const histogram_t *h, uint64_t wire_ns);
+	void report_percentiles_named(const char *const *names, const histogram_t *const *h, int n);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef RING_H
+#define RING_H
+
+/* Lock-free ring buffer of fixed size elements for exactly one producer
+ * and one consumer thread.  The producer only writes head, the consumer
+ * only writes tail, so no locks or read-modify-write atomics are needed.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	uint8_t *buf;
+	size_t elem_size;
+	unsigned int mask;
+	unsigned int head __attribute__((aligned(64)));	/* next slot to write */
+	unsigned int tail __attribute__((aligned(64)));	/* next slot to read */
+} ring_t;
+
+/* size must be a power of two, returns 0 on success */
+static inline int ring_init(ring_t *r, unsigned int size, size_t elem_size)
+{
+	r->buf = calloc(size, elem_size);
+	r->elem_size = elem_size;
+	r->mask = size - 1;
+	r->head = r->tail = 0;
+
+	return r->buf ? 0 : -1;
+}
+
+static inline void ring_free(ring_t *r)
+{
+	free(r->buf);
+	r->buf = NULL;
+}
+
+/* returns 0 if the ring is full */
+static inline int ring_push(ring_t *r, const void *elem)
+{
+	unsigned int head = r->head;
+
+	if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) > r->mask)
+		return 0;
+
+	memcpy(r->buf + (head & r->mask) * r->elem_size, elem, r->elem_size);
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/* returns 0 if the ring is empty */
+static inline int ring_pop(ring_t *r, void *elem)
+{
+	unsigned int tail = r->tail;
+
+	if (__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == tail)
+		return 0;
+
+	memcpy(elem, r->buf + (tail & r->mask) * r->elem_size, r->elem_size);
+	__atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+#endif
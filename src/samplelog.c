@@ -0,0 +1,170 @@
+#include "samplelog.h"
+
+#if defined (HAVE_CONFIG_H)
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined (HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+
+#define log_err(M, ...) fprintf(stderr, "%s:%d: errno: %s " M "\n", __FILE__, __LINE__, strerror(errno), ##__VA_ARGS__)
+
+struct slog {
+	int fd;
+	uint64_t records;
+#if defined (HAVE_SYS_MMAN_H)
+	uint8_t *map;		/* current chunk */
+	off_t map_off;		/* file offset of the current chunk */
+	size_t pos;		/* write position within the chunk */
+#else
+	FILE *fp;
+#endif
+};
+
+static int update_records(slog_t *log)
+{
+	uint64_t n = log->records;
+
+	if (pwrite(log->fd, &n, sizeof n, offsetof(slog_header_t, records)) != sizeof n) {
+		log_err("pwrite() failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+#if defined (HAVE_SYS_MMAN_H)
+static int map_chunk(slog_t *log, off_t off)
+{
+	if (log->map && munmap(log->map, SLOG_CHUNK) < 0) {
+		log_err("munmap() failed");
+		return -1;
+	}
+
+	log->map = NULL;
+
+	if (ftruncate(log->fd, off + SLOG_CHUNK) < 0) {
+		log_err("ftruncate() failed");
+		return -1;
+	}
+
+	void *p = mmap(NULL, SLOG_CHUNK, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, off);
+	if (p == MAP_FAILED) {
+		log_err("mmap() failed");
+		return -1;
+	}
+
+	log->map = p;
+	log->map_off = off;
+	log->pos = 0;
+
+	return 0;
+}
+#endif
+
+slog_t *slog_create(const char *path, const slog_header_t *hdr)
+{
+	slog_header_t h = *hdr;
+	uint8_t head[SLOG_HEADER_SIZE];
+	slog_t *log = calloc(1, sizeof *log);
+
+	if (!log)
+		return NULL;
+
+	memcpy(h.magic, SLOG_MAGIC, sizeof h.magic);
+	h.version = SLOG_VERSION;
+	h.header_size = SLOG_HEADER_SIZE;
+	h.record_size = sizeof(slog_record_t);
+	h.records = 0;
+
+	memset(head, 0, sizeof head);
+	memcpy(head, &h, sizeof h);
+
+	log->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (log->fd < 0) {
+		log_err("unable to create %s", path);
+		free(log);
+		return NULL;
+	}
+
+#if defined (HAVE_SYS_MMAN_H)
+	if (map_chunk(log, 0) < 0) {
+		close(log->fd);
+		free(log);
+		return NULL;
+	}
+	memcpy(log->map, head, sizeof head);
+	log->pos = sizeof head;
+#else
+	log->fp = fdopen(log->fd, "w");
+	if (!log->fp || fwrite(head, sizeof head, 1, log->fp) != 1) {
+		log_err("unable to write %s", path);
+		close(log->fd);
+		free(log);
+		return NULL;
+	}
+#endif
+
+	return log;
+}
+
+int slog_write(slog_t *log, const slog_record_t *rec)
+{
+#if defined (HAVE_SYS_MMAN_H)
+	if (log->pos == SLOG_CHUNK) {
+		if (map_chunk(log, log->map_off + SLOG_CHUNK) < 0)
+			return -1;
+		update_records(log);
+	}
+
+	memcpy(log->map + log->pos, rec, sizeof *rec);
+	log->pos += sizeof *rec;
+#else
+	if (fwrite(rec, sizeof *rec, 1, log->fp) != 1)
+		return -1;
+#endif
+
+	log->records++;
+
+	return 0;
+}
+
+int slog_close(slog_t *log)
+{
+	int r = 0;
+
+#if defined (HAVE_SYS_MMAN_H)
+	off_t size = log->map_off + log->pos;
+
+	if (munmap(log->map, SLOG_CHUNK) < 0)
+		r = -1;
+	if (ftruncate(log->fd, size) < 0)
+		r = -1;
+#else
+	if (fflush(log->fp) != 0)
+		r = -1;
+#endif
+
+	if (update_records(log) < 0)
+		r = -1;
+
+#if defined (HAVE_SYS_MMAN_H)
+	if (close(log->fd) < 0)
+		r = -1;
+#else
+	if (fclose(log->fp) != 0)
+		r = -1;
+#endif
+
+	free(log);
+
+	return r;
+}
@@ -0,0 +1,63 @@
+#ifndef SAMPLELOG_H
+#define SAMPLELOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Binary sample log, host byte order.
+ *
+ * The file starts with an slog_header_t describing the run, followed by
+ * one slog_record_t per sample. Timestamps are integer nanoseconds since
+ * the start of the run. The log is written through a sliding mmap()
+ * window, so memory use does not depend on the number of samples and all
+ * samples written so far survive a crash of the writer. The header's
+ * record count is updated every SLOG_CHUNK bytes and on close; readers
+ * should stop at the first record with rx_ns == 0.
+ */
+#define SLOG_MAGIC       "SLTLOG1"
+#define SLOG_VERSION     1
+#define SLOG_HEADER_SIZE 384
+#define SLOG_CHUNK       (3 << 20)	/* multiple of page and record size */
+
+/* slog_header_t.flags */
+#define SLOG_FRAMED      0x1
+#define SLOG_THREADED    0x2
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t flags;
+	uint32_t baud;
+	uint32_t count;		/* bytes per packet */
+	uint32_t window;
+	uint32_t reserved;
+	uint64_t samples;	/* requested, 0 if unbounded */
+	uint64_t wait_ns;
+	uint64_t start_ns;	/* wall clock time of the start of the run */
+	uint64_t records;	/* records in the log */
+	char     port[128];
+} slog_header_t;
+
+typedef struct {
+	uint64_t tx_ns;
+	uint64_t rx_ns;
+	uint32_t seq;
+	uint32_t size;
+} slog_record_t;
+
+typedef struct slog slog_t;
+
+	slog_t  *slog_create(const char *path, const slog_header_t *hdr);
+	int      slog_write(slog_t *log, const slog_record_t *rec);
+	int      slog_close(slog_t *log);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -25,10 +25,6 @@
 
 #include <math.h>
 
-#ifndef INFINITY
-#define INFINITY (1.0/0.0)
-#endif 
-
 #include <limits.h>
 #include <float.h>
 #include <signal.h>
@@ -41,27 +37,78 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #if defined (HAVE_SYS_UTSNAME_H)
 #include <sys/utsname.h>
 #endif
 
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#if defined (HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
 #include "hr_timer.h"
+#include "ring.h"
 
 #if defined (HAVE_LINUX_SERIAL_H)
 #include <linux/serial.h>
 #endif
 
 #include "serial.h"
+#include "packet.h"
+#include "probe.h"
+#include "histogram.h"
+#include "samplelog.h"
+#include "report.h"
+#include "analyze.h"
+#include "compare.h"
+#include "pace.h"
+#include "emulate.h"
+#include "calib.h"
+#include "harden.h"
+#include "noise.h"
 
 #define DEBUG 1
 
-#define HISTLEN  10
-#define TERMWIDTH 50
+/* packets are tagged with one byte, so at most 255 may be in flight */
+#define MAX_WINDOW 255
 
-#ifndef SQUARE
-#define SQUARE(a) ( (a) * (a) )
-#endif
+/* number of recent packets whose fate is remembered for loss accounting */
+#define TRACK_LEN 1024
+
+/* sequence numbers wrap around in long runs */
+#define SEQ_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+/* samples buffered between the RX thread and the main thread */
+#define RESULT_RING_LEN 65536
+
+/* -o values buffered until the reporter writes them, REPORT_HZ times
+   a second */
+#define OUT_RING_LEN 65536
+
+/* --framed without --loss-timeout: replies missing for this many times
+   the slowest roundtrip so far, but at least the minimum, count as lost */
+#define LOSS_RTT_FACTOR 4
+#define LOSS_TIMEOUT_MIN_MS 10
+
+/* --framed: a port that has not answered for this long is given up on */
+#define LOSS_GIVE_UP_MS 10000
+
+/* maximum number of ports measured concurrently */
+#define MAX_PORTS 64
+
+/* roundtrips of each kind timed to find the noise floor of the tester */
+#define CALIB_ROUNDS 1000
+
+/* stack prefaulted by --harden */
+#define HARDEN_STACK (512 * 1024)
+
+/* stack of the threads the tester starts, which --harden locks in as a
+   whole, instead of the default of usually 8 MB */
+#define THREAD_STACK (1024 * 1024)
 
 #ifndef MIN
 #define MIN(a,b) ( (a) < (b) ? (a) : (b) )
@@ -77,142 +124,2446 @@
 
 static int printinterval = 1;
 
-static volatile sig_atomic_t signal_received = 0;
+/* how often the reporter redraws the progress line per second */
+#define REPORT_HZ 10
+
+/* long options without a short equivalent */
+enum {
+    OPT_WINDOW = 256,
+    OPT_FRAMED,
+    OPT_THREADS,
+    OPT_TX_CPU,
+    OPT_RX_CPU,
+    OPT_LOG,
+    OPT_DURATION,
+    OPT_INTERVAL,
+    OPT_ANALYZE,
+    OPT_COMPARE,
+    OPT_TAIL,
+    OPT_THRESHOLD,
+    OPT_WAIT_STRATEGY,
+    OPT_CLOCK,
+    OPT_PHASES,
+    OPT_SWEEP,
+    OPT_SWEEP_BAUD,
+    OPT_SWEEP_COUNT,
+    OPT_SWEEP_SAMPLES,
+    OPT_SWEEP_TIME,
+    OPT_BULK,
+    OPT_RATE,
+    OPT_PACE,
+    OPT_SEED,
+    OPT_SPIN,
+    OPT_EMULATE,
+    OPT_SUBTRACT,
+    OPT_ECHO,
+    OPT_HARDEN,
+    OPT_NOISE,
+    OPT_BREAKTRACE,
+    OPT_LOSS_TIMEOUT,
+};
+
+/* most baud rates and packet sizes of a --sweep */
+#define MAX_SWEEP 64
+
+/* what each combination of a --sweep takes at most by default */
+#define SWEEP_SAMPLES 1000
+#define SWEEP_TIME 5.0
+
+/* state of a tracked packet */
+enum {
+    PKT_PENDING = 1,
+    PKT_DONE,
+    PKT_LOST,
+};
+
+/* stops the run, set on errors too; interrupted only by signals */
+static volatile sig_atomic_t signal_received = 0;
+static volatile sig_atomic_t interrupted = 0;
+
+static void fatal(const char *msg, ...)
+{
+    va_list ap;
+
+    va_start(ap, msg);
+    vfprintf(stderr, msg, ap);
+    va_end(ap);
+    fprintf(stderr, ". Exiting.\n\n");
+    exit(EXIT_FAILURE);
+}
+
+/* memory allocation error handling */
+static void check_mem(void *p)
+{
+    if (!p)
+        fatal("out of memory");
+}
+
+#if defined (HAVE_SYS_UTSNAME_H)
+void print_uname()
+{
+    struct utsname u;
+    uname (&u);
+    printf ("> running on %s release %s (version %s) on %s\n",
+            u.sysname, u.release, u.version, u.machine);
+}
+#endif
+
+/* sets the process to "policy" policy at given priority */
+static int set_realtime_priority(int policy, int prio)
+{
+#if defined (HAVE_SCHED_H)
+    struct sched_param schp;
+    memset(&schp, 0, sizeof(schp));
+
+    schp.sched_priority = prio;
+    if (sched_setscheduler(0, policy, &schp) != 0) {
+        perror("sched_setscheduler");
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s -p <port> ...\n"
+           "       %s --analyze <file> ...\n"
+           "       %s --compare <base> <new>\n\n"
+           "  -p, --port=port    serial port to run tests on, may be given more\n"
+           "                     than once or as a comma separated list\n"
+           "  -b, --baud=baud    baud rate (default: 9600)\n"
+#if defined (HAVE_SCHED_H)
+           "  -R, --realtime     use realtime scheduling (default: no)\n"
+           "  -P, --priority=n   scheduling priority, use with -R\n"
+           "                     (default: 99)\n\n"
+#endif
+           "  -S, --samples=n    to take for the measurement (default: 10000)\n"
+           "      --duration=t   stop after given time, e.g. 90s, 30m, 12h or 3d, or\n"
+           "                     run until interrupted with inf; takes as many\n"
+           "                     samples as fit unless -S is given\n"
+           "      --interval=t   print statistics of every interval of given length\n"
+           "                     (default: 1s with --duration, else off)\n"
+           "  -c, --count=n      number of bytes to send per sample (default: 1)\n"
+           "  -w, --wait=ms      time interval between measurements, fractions of\n"
+           "                     a ms are fine (default: 0)\n"
+           "  -r, --random-wait  use random interval between wait and 2*wait,\n"
+           "                     same as --pace=uniform\n"
+           "      --pace=dist    distribution of the gaps of --wait or --rate:\n"
+           "                     fixed, uniform or exp (default: fixed)\n"
+           "      --seed=n       seed of the random gaps (default: random)\n"
+           "      --spin=us      busy wait the last us before each send\n"
+           "                     instead of sleeping (default: 0)\n"
+#if defined (HAVE_PTHREAD_H)
+           "      --rate=n       send n packets per second on a fixed schedule,\n"
+           "                     whether the replies are in or not, and report the\n"
+           "                     latencies from when each packet was due as well;\n"
+           "                     runs with --threads and a --window of 255\n"
+           "                     unless given\n"
+#endif
+           "      --window=n     number of packets to keep in flight (default: 1)\n"
+           "      --framed       send sequence numbered, checksummed packets and\n"
+           "                     count lost, late, duplicated, reordered and corrupt\n"
+           "                     packets instead of stopping (default: no)\n"
+           "      --loss-timeout=t  count the packets in flight as lost when no\n"
+           "                     reply came for t, use with --framed (default: 4\n"
+           "                     times the slowest roundtrip, 10ms .. 1s)\n"
+#if defined (HAVE_PTHREAD_H)
+           "      --threads      send and receive in separate threads (default: no)\n"
+           "      --tx-cpu=n     pin the TX thread to given CPU, use with --threads\n"
+           "      --rx-cpu=n     pin the RX thread to given CPU, use with --threads\n"
+#endif
+           "      --wait-strategy=s\n"
+           "                     how to wait for replies: select, poll, epoll,\n"
+           "                     vmin (blocking read of a whole packet, a lost\n"
+           "                     reply blocks until the next one) or spin (busy\n"
+           "                     polling read, costs a full core) (default: select)\n"
+           "\n"
+#if defined (HAVE_LINUX_SERIAL_H)
+#if defined (ASYNC_LOW_LATENCY)
+           "  -a, --async        set ASYNC_LOW_LATENCY flag (default: no)\n"
+#endif
+           "  -x  --xmit=n       set xmit_fifo_size to given number (default: 0)\n"
+#endif
+           "      --clock=c      time stamp with tsc (the CPU's time stamp counter,\n"
+           "                     if it is stable) or system (default: tsc)\n"
+           "      --phases       time write() returning, the first and the last byte\n"
+           "                     of each reply and the gaps between its bytes\n"
+           "      --sweep[=fmt]  measure all combinations of the --sweep-baud rates\n"
+           "                     and --sweep-count sizes and write a matrix of the\n"
+           "                     results as csv or json to -o file or stdout\n"
+           "      --sweep-baud=list  comma separated baud rates or all\n"
+           "                     (default: 9600 to 921600)\n"
+           "      --sweep-count=list comma separated packet sizes\n"
+           "                     (default: 1,16,64,256)\n"
+           "      --sweep-samples=n  samples per combination at most (default: 1000)\n"
+           "      --sweep-time=t     time per combination at most (default: 5s)\n"
+#if defined (HAVE_PTHREAD_H)
+           "      --bulk         stream data over the loopback as fast as the port\n"
+           "                     takes it in blocks of -c bytes (default: 4096) for\n"
+           "                     --duration (default: 10s) and report the throughput\n"
+#endif
+#if defined (HAVE_POSIX_OPENPT)
+           "      --emulate[=model]  measure a pseudo terminal whose other end\n"
+           "                     echoes like a link of -b baud with the model\n"
+           "                     delay=t,jitter=t,dist=uniform|exp,batch=t,loss=%%\n"
+           "                     e.g. delay=100us,jitter=50us,batch=1ms,loss=0.1\n"
+#endif
+           "      --harden[=cpu] lock and prefault all memory and with cpu, send\n"
+           "                     and receive on it, keep the rest of the tester off\n"
+           "                     it and check that it is isolated and free of the\n"
+           "                     interrupts of the ports\n"
+           "      --noise        count context switches, page faults and port\n"
+           "                     interrupts during every sample and split the\n"
+           "                     report into clean and disturbed samples\n"
+           "      --breaktrace=t[,before=n][,after=n][,keep][,file=f]\n"
+           "                     on a sample over t (e.g. 5ms), mark the kernel\n"
+           "                     trace, write the n samples before (default: 100)\n"
+           "                     and after (default: 0) it with all their time\n"
+           "                     stamps to f (default: breaktrace.txt) and stop,\n"
+           "                     or with keep, carry on\n"
+           "      --echo[=stamp] answer an initiator on the other end of the link\n"
+           "                     instead of measuring: return what arrives at\n"
+           "                     once, or with stamp whole --framed packets of\n"
+           "                     -c bytes with the time taken put into them,\n"
+           "                     which the initiator subtracts\n"
+           "      --subtract[=f] take the noise floor of the tester, the fastest\n"
+           "                     tool (time stamps, write and read) or pty (a\n"
+           "                     pty echoing at once) roundtrip, off every sample\n"
+           "                     (default: tool)\n"
+           "  -o, --output=file  write the output to file\n"
+           "      --log=file     write a binary log of all samples to file\n"
+           "      --analyze      print the statistics of the -o or --log files\n"
+           "                     given as arguments instead of measuring\n"
+           "      --compare      compare the percentiles of two such files, exit\n"
+           "                     with 2 if the new one has a tail regression\n"
+           "      --tail=p       percentile checked by --compare (default: 99.9)\n"
+           "      --threshold=n  tolerated increase of the tail percentile in\n"
+           "                     percent (default: 10)\n\n"
+           "  -h, --help         this help\n"
+           "  -V, --version      print current version\n\n"
+           "Report bugs to Jakob Flierl <jakob.flierl@gmail.com>\n"
+           "Website and manual: https://github.com/koppi/serial-latency-test\n"
+           "\n", argv0, argv0, argv0);
+}
+
+static void print_version(void)
+{
+    printf("%s version %s\n", PACKAGE, VERSION);
+}
+
+static void sighandler(int sig)
+{
+	if (!signal_received)
+		fprintf(stderr,"\n\n> caught signal - shutting down.\n");
+    signal_received = 1;
+    interrupted = 1;
+}
+
+/* a packet which has been sent recently */
+typedef struct {
+    timerStruct sent;
+    uint64_t intended_ns;       /* --rate: when it was due, ns since the start */
+    uint32_t seq;
+    int state;          /* PKT_* */
+    int depth;          /* packets in flight when it was sent, incl. itself */
+    noise_snap_t noise; /* --noise: the host's counters when it was sent */
+} inflight_t;
+
+/* packet accounting of --framed mode */
+typedef struct {
+    unsigned long sent, received, lost, late, duplicated, reordered, corrupt;
+} pkt_stats_t;
+
+/* latency statistics of the packets sent at a given window depth */
+typedef struct {
+    uint64_t cnt;
+    double min, max, sum;
+} depth_stats_t;
+
+typedef struct {
+    PORTTYPE fd;
+    int  baud;
+    char port[PATH_MAX];
+#if defined (HAVE_TERMIOS_H)
+    struct termios opts;
+#endif
+    serial_wait_t wait;
+    int frame_bits;     /* bits per byte on the wire */
+} serial_t;
+
+/* fate of the last TRACK_LEN packets sent */
+typedef struct {
+    inflight_t *inflight;       /* indexed by seq % TRACK_LEN */
+    pkt_stats_t ps;
+    /* packets [seq_old, seq_tx) may still be in flight, seq_max is one
+       past the highest sequence number received so far */
+    unsigned int seq_tx, seq_old, seq_max;
+    int pending;
+} track_t;
+
+/* --phases: where the time of a roundtrip goes, in ns */
+typedef struct {
+    histogram_t write;  /* time stamp to write() returning */
+    histogram_t first;  /* time stamp to reading the first byte */
+    histogram_t last;   /* first byte to the whole packet read */
+    histogram_t gap;    /* between reading consecutive bytes of a packet */
+} phases_t;
+
+/* latency statistics of all samples taken */
+typedef struct {
+    uint64_t cnt_a;
+    histogram_t hist;
+
+    depth_stats_t *depth_stats;
+
+    /* progress for the reporter, stored with atomics by the measurement */
+    uint64_t live_count, live_ns, live_min, live_max, live_mean;
+
+    /* --interval: samples go to ihist[icur]. A finished interval is handed
+       to the reporter by setting iclosed to its index + 1, the reporter
+       prints and resets it and sets iclosed back to 0. */
+    histogram_t ihist[2];
+    int icur, iclosed;
+    uint64_t interval_end;      /* ns since the start of the run */
+    unsigned long interval_lost;
+    uint64_t iclosed_end;
+    long iclosed_lost;
+
+    phases_t *phases;   /* NULL without --phases */
+
+    /* --rate: latencies from the time a packet was due rather than sent,
+       and how late it was sent */
+    histogram_t *corrected, *send_lag;
+
+    histogram_t turnaround;     /* of an --echo=stamp responder */
+
+    noise_stats_t *noise;       /* NULL without --noise */
+} stats_t;
+
+/* one measured roundtrip, timestamps in ns since the start of the run */
+typedef struct {
+    uint64_t tx_ns, rx_ns;
+    uint64_t first_ns;  /* first byte read, --phases only */
+    uint64_t intended_ns;       /* when it was due to be sent, --rate only */
+    uint32_t turnaround_ns;     /* the responder took, --framed only */
+    noise_delta_t noise;        /* what the host did meanwhile, --noise only */
+    uint32_t seq;
+    int depth;
+} sample_t;
+
+/* --breaktrace: the samples around one that took longer than threshold_ns.
+   They are copied out of a ring once the ones after it are in and handed
+   to the reporter, which writes them to f. */
+typedef struct {
+    sample_t smp;
+    uint64_t latency;   /* as reported, less floor and turnaround */
+} bt_entry_t;
+
+typedef struct {
+    uint64_t threshold_ns;
+    int before, after;  /* samples kept around the spike */
+    int keep;           /* keep measuring after a spike */
+    FILE *f;
+
+    bt_entry_t *ring;   /* the last before + 1 + after samples */
+    int len;
+    uint64_t seen;      /* samples put into the ring */
+    uint64_t spike;     /* index of the spike in all samples seen */
+    int collecting;     /* samples still to come after the spike */
+    int stopped;        /* no more spikes without keep */
+
+    bt_entry_t *dump;   /* handed to the reporter by setting dump_ready */
+    int dump_len, dump_spike;
+    int dump_ready;
+    unsigned long spikes, skipped, written;
+} breaktrace_t;
+
+typedef struct {
+    serial_t *s;
+    int nr_samples;
+    int nr_count;
+    int window;
+    int framed;
+    double loss_timeout;        /* s, or 0 to derive it from the roundtrips */
+    int silent_ms;              /* waited without a reply in a row */
+    int threaded;
+    double wait;                /* ms */
+    pace_t pace;                /* gaps between sends, --wait or --rate */
+    double duration;            /* s, or 0 */
+    double interval;            /* s, or 0 */
+    int show_port;              /* in interval rows */
+
+    probe_t probe;              /* the packet out and its reply */
+
+    track_t track;
+    stats_t stats;
+
+    timerStruct run_begin, run_end;
+    int err;
+
+    int phases;
+    double rate;                /* --rate in packets/s, or 0 */
+    slog_t *log;                /* --log, or NULL */
+    FILE *out;                  /* -o, or NULL */
+    ring_t out_ring;            /* uint64_t latencies for out, to the reporter */
+    const calib_t *calib;       /* noise floor of the tester, or NULL */
+    noise_t *noise;             /* --noise, or NULL */
+    breaktrace_t *bt;           /* --breaktrace, or NULL */
+    uint64_t floor_ns;          /* --subtract: taken off every sample */
+    int cpu;                    /* --harden=cpu to sample on, or -1 */
+
+#if defined (HAVE_PTHREAD_H)
+    int tx_cpu, rx_cpu;
+    ring_t sent_ring;           /* inflight_t, TX thread -> RX thread */
+    ring_t result_ring;         /* sample_t, RX thread -> main thread */
+    int tx_done, rx_done;
+    pthread_barrier_t *start;   /* lines up the ports of a multi-port run */
+#endif
+} test_t;
+
+static void track_init(track_t *k)
+{
+    memset(k, 0, sizeof *k);
+    k->inflight = calloc(TRACK_LEN, sizeof *k->inflight);
+    check_mem(k->inflight);
+}
+
+static void track_free(track_t *k)
+{
+    free(k->inflight);
+}
+
+static void track_sent(track_t *k, const inflight_t *p)
+{
+    k->inflight[p->seq % TRACK_LEN] = *p;
+    k->seq_tx = p->seq + 1;
+    k->pending++;
+    k->ps.sent++;
+}
+
+/* accounts for a received packet, returns the packet it answers if this
+   is a valid sample, NULL otherwise */
+static inflight_t *track_received(track_t *k, uint32_t seq)
+{
+    if (!SEQ_BEFORE(seq, k->seq_tx)) {
+        k->ps.corrupt++;
+        return NULL;
+    }
+
+    inflight_t *p = &k->inflight[seq % TRACK_LEN];
+
+    if (k->seq_tx - seq > TRACK_LEN || p->state == PKT_LOST) {
+        if (p->state == PKT_LOST) {
+            p->state = PKT_DONE;
+            k->ps.lost--;
+        }
+        k->ps.late++;
+        return NULL;
+    }
+
+    if (p->state == PKT_DONE) {
+        k->ps.duplicated++;
+        return NULL;
+    }
+
+    p->state = PKT_DONE;
+    k->pending--;
+    k->ps.received++;
+
+    if (SEQ_BEFORE(seq + 1, k->seq_max))
+        k->ps.reordered++;
+    else
+        k->seq_max = seq + 1;
+
+    unsigned int seq_old = k->seq_old;
+    while (seq_old != k->seq_tx && k->inflight[seq_old % TRACK_LEN].state != PKT_PENDING)
+        seq_old++;
+
+    /* read by the TX thread in threaded mode */
+    __atomic_store_n(&k->seq_old, seq_old, __ATOMIC_RELEASE);
+
+    return p;
+}
+
+/* gives up on everything in flight */
+static void track_timeout(track_t *k)
+{
+    unsigned int seq;
+
+    for (seq = k->seq_old; seq != k->seq_tx; ++seq) {
+        inflight_t *p = &k->inflight[seq % TRACK_LEN];
+        if (p->state == PKT_PENDING) {
+            p->state = PKT_LOST;
+            k->ps.lost++;
+        }
+    }
+
+    k->pending = 0;
+    __atomic_store_n(&k->seq_old, k->seq_tx, __ATOMIC_RELEASE);
+}
+
+static void stats_init(stats_t *st, int window, int phases, int open_loop, int noise)
+{
+    memset(st, 0, sizeof *st);
+
+    st->depth_stats = calloc(window + 1, sizeof *st->depth_stats);
+    check_mem(st->depth_stats);
+
+    if (phases) {
+        st->phases = malloc(sizeof *st->phases);
+        check_mem(st->phases);
+        histogram_reset(&st->phases->write);
+        histogram_reset(&st->phases->first);
+        histogram_reset(&st->phases->last);
+        histogram_reset(&st->phases->gap);
+    }
+
+    if (open_loop) {
+        st->corrected = malloc(sizeof *st->corrected);
+        st->send_lag = malloc(sizeof *st->send_lag);
+        check_mem(st->corrected);
+        check_mem(st->send_lag);
+        histogram_reset(st->corrected);
+        histogram_reset(st->send_lag);
+    }
+
+    if (noise) {
+        st->noise = malloc(sizeof *st->noise);
+        check_mem(st->noise);
+        noise_stats_reset(st->noise);
+    }
+
+    histogram_reset(&st->hist);
+    histogram_reset(&st->ihist[0]);
+    histogram_reset(&st->ihist[1]);
+    histogram_reset(&st->turnaround);
+}
+
+static void stats_free(stats_t *st)
+{
+    free(st->depth_stats);
+    free(st->phases);
+    free(st->corrected);
+    free(st->send_lag);
+    free(st->noise);
+}
+
+static void stats_add(stats_t *st, uint64_t ns, int depth)
+{
+    double delay = ns / 1e6;
+
+    depth_stats_t *d = &st->depth_stats[depth];
+    if (d->cnt == 0 || delay < d->min) d->min = delay;
+    if (delay > d->max) d->max = delay;
+    d->sum += delay;
+    d->cnt++;
+
+    histogram_add(&st->hist, ns);
+    histogram_add(&st->ihist[st->icur], ns);
+
+    st->cnt_a++;
+
+    /* torn snapshots only mix values of consecutive samples on screen */
+    __atomic_store_n(&st->live_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->live_min, st->hist.min, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->live_max, st->hist.max, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->live_mean, (uint64_t)st->hist.mean, __ATOMIC_RELAXED);
+    __atomic_store_n(&st->live_count, st->cnt_a, __ATOMIC_RELEASE);
+}
+
+/* adds all samples of src to dst */
+static void stats_merge(stats_t *dst, const stats_t *src, int window)
+{
+    int i;
+
+    histogram_merge(&dst->hist, &src->hist);
+    histogram_merge(&dst->turnaround, &src->turnaround);
+    dst->cnt_a += src->cnt_a;
+
+    if (dst->phases && src->phases) {
+        histogram_merge(&dst->phases->write, &src->phases->write);
+        histogram_merge(&dst->phases->first, &src->phases->first);
+        histogram_merge(&dst->phases->last, &src->phases->last);
+        histogram_merge(&dst->phases->gap, &src->phases->gap);
+    }
+
+    if (dst->corrected && src->corrected) {
+        histogram_merge(dst->corrected, src->corrected);
+        histogram_merge(dst->send_lag, src->send_lag);
+    }
+
+    if (dst->noise && src->noise)
+        noise_stats_merge(dst->noise, src->noise);
+
+    for (i = 1; i <= window; ++i) {
+        const depth_stats_t *s = &src->depth_stats[i];
+        depth_stats_t *d = &dst->depth_stats[i];
+        if (s->cnt == 0)
+            continue;
+        if (d->cnt == 0 || s->min < d->min) d->min = s->min;
+        if (s->max > d->max) d->max = s->max;
+        d->sum += s->sum;
+        d->cnt += s->cnt;
+    }
+}
+
+/* closed loop: waits the next gap after the previous reply */
+static void wait_interval(test_t *t)
+{
+    timerStruct now;
+
+    if (t->wait > 0) {
+        GetHighResolutionTime(&now);
+        pace_wait(&t->pace, &t->run_begin,
+                  ConvertTimeDifferenceToNs(&now, &t->run_begin) + pace_gap(&t->pace),
+                  &signal_received);
+    }
+}
+
+static void make_sample(test_t *t, sample_t *smp, const inflight_t *p, timerStruct *end)
+{
+    smp->tx_ns = ConvertTimeDifferenceToNs((timerStruct *)&p->sent, &t->run_begin);
+    smp->rx_ns = ConvertTimeDifferenceToNs(end, &t->run_begin);
+    smp->intended_ns = p->intended_ns;
+    smp->first_ns = t->phases ? ConvertTimeDifferenceToNs(&t->probe.first, &t->run_begin) : 0;
+    smp->turnaround_ns = probe_turnaround(&t->probe);
+
+    if (t->noise) {
+        noise_snap_t now;
+        noise_take(t->noise, &now);
+        noise_delta(&smp->noise, &p->noise, &now);
+    }
+    smp->seq = p->seq;
+    smp->depth = p->depth;
+}
+
+static void print_interval_header(int show_port)
+{
+    printf("%s      time  samples      min      avg      p50      p99    p99.9      max     lost [ms]\n",
+           show_port ? " port                " : "");
+}
+
+static void print_interval(test_t *t, const histogram_t *h, uint64_t end_ns, long lost)
+{
+    unsigned long secs = end_ns / 1000000000;
+
+    if (t->show_port)
+        printf(" %-20s", t->s->port);
+
+    printf(" %3lu:%02lu:%02lu %8lu %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f %8ld\n",
+           secs / 3600, secs / 60 % 60, secs % 60, (unsigned long)h->total,
+           h->total ? h->min / 1e6 : 0.0, h->mean / 1e6,
+           histogram_percentile(h, 50) / 1e6, histogram_percentile(h, 99) / 1e6,
+           histogram_percentile(h, 99.9) / 1e6, h->max / 1e6, lost);
+}
+
+/* hands the current interval to the reporter and starts the next one once
+   now_ns is past its end */
+static void close_interval(test_t *t, uint64_t now_ns)
+{
+    stats_t *st = &t->stats;
+    uint64_t len = t->interval * 1e9;
+
+    if (st->interval_end == 0)
+        st->interval_end = len;
+
+    if (now_ns < st->interval_end)
+        return;
+
+    /* the reporter has not printed the last one yet, keep counting */
+    if (__atomic_load_n(&st->iclosed, __ATOMIC_ACQUIRE))
+        return;
+
+    /* updated by the RX thread in threaded mode */
+    unsigned long lost = __atomic_load_n(&t->track.ps.lost, __ATOMIC_RELAXED);
+
+    st->iclosed_end = st->interval_end;
+    st->iclosed_lost = lost - st->interval_lost;
+    st->interval_lost = lost;
+    st->interval_end += len * (1 + (now_ns - st->interval_end) / len);
+
+    __atomic_store_n(&st->iclosed, st->icur + 1, __ATOMIC_RELEASE);
+    st->icur ^= 1;
+}
+
+/* prints the interval handed over by close_interval(), if any */
+static void print_closed_interval(test_t *t)
+{
+    stats_t *st = &t->stats;
+    int c = __atomic_load_n(&st->iclosed, __ATOMIC_ACQUIRE);
+
+    if (!c)
+        return;
+
+    print_interval(t, &st->ihist[c - 1], st->iclosed_end, st->iclosed_lost);
+    histogram_reset(&st->ihist[c - 1]);
+
+    __atomic_store_n(&st->iclosed, 0, __ATOMIC_RELEASE);
+}
+
+/* prints what is left of the intervals once the run is over */
+static void finish_intervals(test_t *t)
+{
+    stats_t *st = &t->stats;
+    histogram_t *h = &st->ihist[st->icur];
+
+    print_closed_interval(t);
+
+    if (t->interval > 0 && h->total > 0)
+        print_interval(t, h, st->interval_end, (long)(t->track.ps.lost - st->interval_lost));
+}
+
+/* tracefs files --breaktrace writes to, -1 if there is no tracefs */
+static int trace_marker_fd = -1, tracing_on_fd = -1;
+
+static void trace_open(void)
+{
+    static const char *dirs[] = { "/sys/kernel/tracing", "/sys/kernel/debug/tracing" };
+    char path[64];
+    int i;
+
+    for (i = 0; i < 2 && trace_marker_fd < 0; ++i) {
+        snprintf(path, sizeof path, "%s/trace_marker", dirs[i]);
+        trace_marker_fd = open(path, O_WRONLY);
+        snprintf(path, sizeof path, "%s/tracing_on", dirs[i]);
+        if (trace_marker_fd >= 0)
+            tracing_on_fd = open(path, O_WRONLY);
+    }
+}
+
+/* marks the spike in the kernel trace, and stops tracing if the run stops
+   as well, so the trace ends with what led up to the spike */
+static void trace_spike(test_t *t, const sample_t *smp, uint64_t latency)
+{
+    char buf[256];
+    int len;
+
+    if (trace_marker_fd < 0)
+        return;
+
+    len = snprintf(buf, sizeof buf, "serial-latency-test: breaktrace on %s, seq %u took %llu ns\n",
+                   t->s->port, smp->seq, (unsigned long long)latency);
+    if (write(trace_marker_fd, buf, len) < 0)
+        return;
+
+    if (!t->bt->keep && tracing_on_fd >= 0 && write(tracing_on_fd, "0", 1) < 0)
+        return;
+}
+
+/* sets up the breaktrace of t with the settings of cfg, writing to path */
+static void breaktrace_init(test_t *t, const breaktrace_t *cfg, const char *path)
+{
+    breaktrace_t *bt = calloc(1, sizeof *bt);
+    check_mem(bt);
+
+    bt->threshold_ns = cfg->threshold_ns;
+    bt->before = cfg->before;
+    bt->after = cfg->after;
+    bt->keep = cfg->keep;
+    bt->len = bt->before + 1 + bt->after;
+    bt->ring = calloc(bt->len, sizeof *bt->ring);
+    bt->dump = calloc(bt->len, sizeof *bt->dump);
+    check_mem(bt->ring);
+    check_mem(bt->dump);
+
+    bt->f = fopen(path, "w");
+    if (!bt->f)
+        fatal("unable to open breaktrace file '%s'", path);
+
+    t->bt = bt;
+}
+
+static void breaktrace_free(test_t *t)
+{
+    breaktrace_t *bt = t->bt;
+
+    if (!bt)
+        return;
+
+    fclose(bt->f);
+    free(bt->ring);
+    free(bt->dump);
+    free(bt);
+    t->bt = NULL;
+}
+
+/* copies the samples around the spike for the reporter */
+static void breaktrace_hand_over(test_t *t)
+{
+    breaktrace_t *bt = t->bt;
+    uint64_t first = bt->spike >= bt->before ? bt->spike - bt->before : 0;
+    int i;
+
+    bt->dump_len = bt->seen - first;
+    bt->dump_spike = bt->spike - first;
+    for (i = 0; i < bt->dump_len; ++i)
+        bt->dump[i] = bt->ring[(first + i) % bt->len];
+
+    __atomic_store_n(&bt->dump_ready, 1, __ATOMIC_RELEASE);
+
+    if (!bt->keep) {
+        bt->stopped = 1;
+        signal_received = 1;
+    }
+}
+
+static void breaktrace_add(test_t *t, const sample_t *smp, uint64_t latency)
+{
+    breaktrace_t *bt = t->bt;
+    bt_entry_t *e = &bt->ring[bt->seen++ % bt->len];
+
+    e->smp = *smp;
+    e->latency = latency;
+
+    if (bt->collecting > 0) {
+        if (--bt->collecting == 0)
+            breaktrace_hand_over(t);
+        return;
+    }
+
+    if (latency <= bt->threshold_ns || bt->stopped)
+        return;
+
+    /* the reporter is still writing the last one */
+    if (__atomic_load_n(&bt->dump_ready, __ATOMIC_ACQUIRE)) {
+        bt->skipped++;
+        return;
+    }
+
+    bt->spikes++;
+    bt->spike = bt->seen - 1;
+
+    trace_spike(t, smp, latency);
+
+    if (bt->after > 0)
+        bt->collecting = bt->after;
+    else
+        breaktrace_hand_over(t);
+}
+
+/* writes the samples handed over by breaktrace_hand_over(), if any */
+static void breaktrace_write(test_t *t)
+{
+    breaktrace_t *bt = t->bt;
+    int i;
+
+    if (!__atomic_load_n(&bt->dump_ready, __ATOMIC_ACQUIRE))
+        return;
+
+    const bt_entry_t *spike = &bt->dump[bt->dump_spike];
+
+    fprintf(bt->f, "# breaktrace of %s: seq %u took %.3f ms, more than %.3f ms\n",
+            t->s->port, spike->smp.seq, spike->latency / 1e6, bt->threshold_ns / 1e6);
+    fprintf(bt->f, "#      seq           tx [ns]        first [ns]           rx [ns]"
+            "     intended [ns]      latency [ns] depth turnaround ivcsw  vcsw minflt majflt  irqs\n");
+
+    for (i = 0; i < bt->dump_len; ++i) {
+        const sample_t *smp = &bt->dump[i].smp;
+
+        fprintf(bt->f, "%c %8u %17llu %17llu %17llu %17llu %17llu %5d %10u %5u %5u %6u %6u %5u\n",
+                i == bt->dump_spike ? '>' : ' ', smp->seq,
+                (unsigned long long)smp->tx_ns, (unsigned long long)smp->first_ns,
+                (unsigned long long)smp->rx_ns, (unsigned long long)smp->intended_ns,
+                (unsigned long long)bt->dump[i].latency, smp->depth, smp->turnaround_ns,
+                smp->noise.ivcsw, smp->noise.vcsw, smp->noise.minflt, smp->noise.majflt,
+                smp->noise.irqs);
+    }
+
+    fprintf(bt->f, "\n");
+    fflush(bt->f);
+    bt->written++;
+
+    __atomic_store_n(&bt->dump_ready, 0, __ATOMIC_RELEASE);
+}
+
+/* writes what was collected after a spike once the run is over */
+static void breaktrace_finish(test_t *t)
+{
+    breaktrace_t *bt = t->bt;
+
+    if (bt->collecting > 0 && !bt->dump_ready) {
+        bt->collecting = 0;
+        breaktrace_hand_over(t);
+    }
+
+    breaktrace_write(t);
+}
+
+/* writes the -o values handed over by record_sample() */
+static void out_write(test_t *t)
+{
+    uint64_t latency;
+
+    while (ring_pop(&t->out_ring, &latency))
+        fprintf(t->out, "%8.2f\n", latency / 1e6);
+}
+
+/* The progress line, the --interval rows and the -o values are written
+   by a reporter thread REPORT_HZ times a second from what the measurement
+   publishes with atomics and rings, so the measurement loops do not touch
+   stdio. */
+typedef struct {
+    test_t *tests;
+    int nr_tests;
+    int progress;       /* redraw the progress line of tests[0] */
+    uint64_t shown;     /* samples on the progress line */
+    time_t last;        /* of the last line kept with a newline */
+#if defined (HAVE_PTHREAD_H)
+    pthread_t thread;
+    int stop;
+#else
+    uint64_t next_ns;   /* of the next redraw from record_sample() */
+#endif
+} reporter_t;
+
+static reporter_t reporter;
+
+static void print_progress(reporter_t *r)
+{
+    stats_t *st = &r->tests[0].stats;
+    uint64_t count = __atomic_load_n(&st->live_count, __ATOMIC_ACQUIRE);
+    time_t now = time(NULL);
+
+    if (count == r->shown)
+        return;
+
+    /* keep a line every printinterval seconds */
+    if (printinterval > 0 && now >= r->last + printinterval) {
+        r->last = now;
+        if (r->shown > 0)
+            printf("\n");
+    }
+
+    r->shown = count;
+
+    printf(" %7llu %8.2f %8.2f %8.2f %8.2f\r", (unsigned long long)count,
+           __atomic_load_n(&st->live_ns, __ATOMIC_RELAXED) / 1e6,
+           __atomic_load_n(&st->live_min, __ATOMIC_RELAXED) / 1e6,
+           __atomic_load_n(&st->live_max, __ATOMIC_RELAXED) / 1e6,
+           __atomic_load_n(&st->live_mean, __ATOMIC_RELAXED) / 1e6);
+}
+
+static void report_tick(reporter_t *r)
+{
+    int i;
+
+    if (r->progress)
+        print_progress(r);
+
+    for (i = 0; i < r->nr_tests; ++i) {
+        print_closed_interval(&r->tests[i]);
+        if (r->tests[i].out)
+            out_write(&r->tests[i]);
+        if (r->tests[i].bt)
+            breaktrace_write(&r->tests[i]);
+    }
+}
+
+#if defined (HAVE_PTHREAD_H)
+/* pthread_create() with a stack of THREAD_STACK */
+static int start_thread(pthread_t *thread, void *(*fn)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    int r;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK);
+    r = pthread_create(thread, &attr, fn, arg);
+    pthread_attr_destroy(&attr);
+
+    return r;
+}
+
+static void *reporter_thread(void *arg)
+{
+    reporter_t *r = arg;
+    struct timespec tick = { 0, 1000000000 / REPORT_HZ };
+
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        nanosleep(&tick, NULL);
+        report_tick(r);
+    }
+
+    return NULL;
+}
+#endif
+
+static void reporter_start(test_t *tests, int nr_tests, int progress)
+{
+    memset(&reporter, 0, sizeof reporter);
+    reporter.tests = tests;
+    reporter.nr_tests = nr_tests;
+    reporter.progress = progress;
+    reporter.last = time(NULL);
+
+#if defined (HAVE_PTHREAD_H)
+    if (start_thread(&reporter.thread, reporter_thread, &reporter) != 0)
+        fatal("unable to create the reporter thread");
+#endif
+}
+
+/* stops the reporter and prints the final state of the run */
+static void reporter_stop(void)
+{
+    int i;
+
+#if defined (HAVE_PTHREAD_H)
+    __atomic_store_n(&reporter.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(reporter.thread, NULL);
+#endif
+
+    if (reporter.progress)
+        print_progress(&reporter);
+
+    for (i = 0; i < reporter.nr_tests; ++i) {
+        finish_intervals(&reporter.tests[i]);
+        if (reporter.tests[i].out)
+            out_write(&reporter.tests[i]);
+        if (reporter.tests[i].bt)
+            breaktrace_finish(&reporter.tests[i]);
+    }
+
+    reporter.nr_tests = 0;
+    reporter.progress = 0;
+}
+
+/* takes the turnaround of the responder and the --subtract noise floor
+   off a latency */
+static uint64_t less_floor(const test_t *t, uint64_t ns, uint32_t turnaround_ns)
+{
+    uint64_t off = t->floor_ns + turnaround_ns;
+
+    return ns > off ? ns - off : 0;
+}
+
+/* adds a sample to the statistics and the output files. The sample log
+   keeps the time stamps as taken, without anything subtracted. */
+static void record_sample(test_t *t, const sample_t *smp)
+{
+    uint64_t latency = less_floor(t, smp->rx_ns - smp->tx_ns, smp->turnaround_ns);
+
+    if (t->interval > 0)
+        close_interval(t, smp->rx_ns);
+
+#if !defined (HAVE_PTHREAD_H)
+    /* no reporter thread, report from here at its rate */
+    if (smp->rx_ns >= reporter.next_ns) {
+        reporter.next_ns = smp->rx_ns + 1000000000 / REPORT_HZ;
+        report_tick(&reporter);
+    }
+#endif
+
+    stats_add(&t->stats, latency, smp->depth);
+
+    if (t->stats.corrected) {
+        histogram_add(t->stats.corrected,
+                      less_floor(t, smp->rx_ns - smp->intended_ns, smp->turnaround_ns));
+        histogram_add(t->stats.send_lag, smp->tx_ns - smp->intended_ns);
+    }
+
+    if (smp->turnaround_ns)
+        histogram_add(&t->stats.turnaround, smp->turnaround_ns);
+
+    if (t->stats.noise)
+        noise_stats_add(t->stats.noise, latency, &smp->noise);
+
+    if (t->bt)
+        breaktrace_add(t, smp, latency);
+
+    if (t->stats.phases) {
+        histogram_add(&t->stats.phases->first, smp->first_ns - smp->tx_ns);
+        histogram_add(&t->stats.phases->last, smp->rx_ns - smp->first_ns);
+    }
+
+    if (t->log) {
+        slog_record_t rec;
+        rec.tx_ns = smp->tx_ns;
+        rec.rx_ns = smp->rx_ns;
+        rec.seq = smp->seq;
+        rec.size = t->nr_count;
+        if (slog_write(t->log, &rec) < 0) {
+            fprintf(stderr, "> unable to write sample log, closing it.\n");
+            slog_close(t->log);
+            t->log = NULL;
+            t->err = 1;
+        }
+    }
+
+    if (t->out) {
+        while (!ring_push(&t->out_ring, &latency)) {
+#if defined (HAVE_PTHREAD_H)
+            sched_yield();
+#else
+            out_write(t);
+#endif
+        }
+    }
+}
+
+/* timestamps packet seq and prepares it for write_packet() */
+static void stamp_packet(test_t *t, inflight_t *p, uint32_t seq, int depth)
+{
+    p->seq = seq;
+    p->state = PKT_PENDING;
+    p->depth = depth;
+
+    if (t->noise)
+        noise_take(t->noise, &p->noise);
+
+    GetHighResolutionTime(&p->sent);
+    p->intended_ns = ConvertTimeDifferenceToNs(&p->sent, &t->run_begin);
+
+    probe_stamp(&t->probe, seq, p->intended_ns);
+}
+
+static int write_packet(test_t *t, const inflight_t *p)
+{
+    int n = probe_send(&t->probe);
+
+    if (t->phases) {
+        timerStruct now;
+        GetHighResolutionTime(&now);
+        histogram_add(&t->stats.phases->write, ConvertTimeDifferenceToNs(&now, (timerStruct *)&p->sent));
+    }
+
+    if (n != t->nr_count) {
+        fprintf(stderr, "serial_write() n = %d nr_count = %d\n", n, t->nr_count);
+        t->err = 1;
+        signal_received = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* --framed: how long to wait for a reply before counting all in flight
+   as lost. Until the first reply is in, and with --loss-timeout, that is
+   fixed, else it follows the slowest roundtrip, so a lost byte stalls a
+   fast link for milliseconds rather than a second. */
+static int loss_timeout_ms(const test_t *t)
+{
+    uint64_t max_ns;
+
+    if (t->loss_timeout > 0)
+        return MAX(1, (int)ceil(t->loss_timeout * 1000));
+
+    if (!__atomic_load_n(&t->stats.live_count, __ATOMIC_ACQUIRE))
+        return SERIAL_TIMEOUT_MS;
+
+    max_ns = __atomic_load_n(&t->stats.live_max, __ATOMIC_RELAXED);
+
+    return RAIL(LOSS_RTT_FACTOR * (int)(max_ns / 1000000 + 1), LOSS_TIMEOUT_MIN_MS, SERIAL_TIMEOUT_MS);
+}
+
+/* reads the next reply and timestamps its arrival in *end. Returns 0 if
+   *seq holds the sequence number to account for with track_received(). */
+static int receive_packet(test_t *t, timerStruct *end, uint32_t *seq)
+{
+    track_t *k = &t->track;
+
+    if (t->framed)
+        t->s->wait.timeout_ms = loss_timeout_ms(t);
+
+    int r = probe_recv(&t->probe, k->seq_old, seq, &k->ps.corrupt);
+
+    GetHighResolutionTime(end);
+
+    /* a lost packet, even the first one, is counted rather than ending the
+       run, unless the port stays silent for good */
+    if (r == PROBE_TIMEOUT && t->framed) {
+        t->silent_ms += t->s->wait.timeout_ms;
+        track_timeout(k);
+        if (t->silent_ms < LOSS_GIVE_UP_MS) {
+            serial_flush(t->s->fd);
+            return -1;
+        }
+        fprintf(stderr, "> no reply for %d s, giving up.\n", t->silent_ms / 1000);
+    } else if (r == PROBE_OK) {
+        t->silent_ms = 0;
+    }
+
+    if (r != PROBE_OK) {
+        if (r == PROBE_TIMEOUT)
+            fprintf(stderr, "serial_read() timeout, nr_count = %d\n", t->nr_count);
+        else if (r == PROBE_CORRUPT)
+            fprintf(stderr, "serial_read() tag = %d expected = %d\n", t->probe.rx[0], k->seq_old & 0xff);
+        else
+            fprintf(stderr, "serial_read() failed, nr_count = %d\n", t->nr_count);
+        t->err = 1;
+        signal_received = 1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* whether to send another packet after the first sent ones */
+static int more_to_send(test_t *t, unsigned long sent)
+{
+    if (signal_received)
+        return 0;
+
+    if (t->nr_samples > 0 && sent >= t->nr_samples)
+        return 0;
+
+    if (t->duration > 0) {
+        timerStruct now;
+        GetHighResolutionTime(&now);
+        if (ConvertTimeDifferenceToSec(&now, &t->run_begin) >= t->duration)
+            return 0;
+    }
+
+    return 1;
+}
+
+/* writes and reads back packets in one thread, keeping up to window
+   packets in flight */
+static void run_sequential(test_t *t)
+{
+    track_t *k = &t->track;
+    timerStruct end;
+    uint32_t seq;
+    int sending = 1;
+
+    while (sending || k->pending > 0) {
+        while (k->seq_tx - k->seq_old < t->window && (sending = more_to_send(t, k->ps.sent))) {
+            inflight_t p;
+
+            wait_interval(t);
+            if (signal_received)
+                break;
+
+            stamp_packet(t, &p, k->seq_tx, k->pending + 1);
+
+            if (write_packet(t, &p) < 0)
+                break;
+
+            track_sent(k, &p);
+        }
+
+        if (signal_received)
+            break;
+
+        if (k->pending == 0)
+            continue;
+
+        if (receive_packet(t, &end, &seq) < 0) {
+            if (signal_received)
+                break;
+            continue;
+        }
+
+        inflight_t *p = track_received(k, seq);
+
+        if (p) {
+            sample_t smp;
+            make_sample(t, &smp, p, &end);
+            record_sample(t, &smp);
+        }
+    }
+}
+
+#if defined (HAVE_PTHREAD_H)
+static void pin_thread(int cpu)
+{
+#if defined (HAVE_PTHREAD_SETAFFINITY_NP)
+    if (cpu < 0)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+
+    int r = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+    if (r != 0)
+        fprintf(stderr, "pthread_setaffinity_np(%d): %s\n", cpu, strerror(r));
+#endif
+}
+
+/* stamps and writes packets, handing their timestamps to the RX thread */
+static void *tx_thread(void *arg)
+{
+    test_t *t = arg;
+    unsigned long sent;
+    uint32_t seq = 0;
+    uint64_t due_ns = 0;
+
+    pin_thread(t->tx_cpu >= 0 ? t->tx_cpu : t->cpu);
+
+    for (sent = 0; more_to_send(t, sent); ++sent, ++seq) {
+        inflight_t p;
+        unsigned int seq_old;
+
+        while (seq - (seq_old = __atomic_load_n(&t->track.seq_old, __ATOMIC_ACQUIRE)) >= t->window) {
+            if (signal_received)
+                goto out;
+            sched_yield();
+        }
+
+        /* open loop: the packets are due one gap after the other, whether
+           the replies to the earlier ones are in or not */
+        if (t->rate > 0) {
+            if (sent > 0)
+                due_ns += pace_gap(&t->pace);
+            pace_wait(&t->pace, &t->run_begin, due_ns, &signal_received);
+        } else {
+            wait_interval(t);
+        }
+        if (signal_received)
+            break;
+
+        stamp_packet(t, &p, seq, seq - seq_old + 1);
+        if (t->rate > 0)
+            p.intended_ns = due_ns;
+
+        /* the ring holds more than window entries, so it is never full */
+        ring_push(&t->sent_ring, &p);
+
+        if (write_packet(t, &p) < 0)
+            break;
+    }
+
+out:
+    __atomic_store_n(&t->tx_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* drains the port, stamps arrivals and hands the samples to the main thread */
+static void *rx_thread(void *arg)
+{
+    test_t *t = arg;
+    track_t *k = &t->track;
+    timerStruct end;
+    inflight_t sent;
+    uint32_t seq;
+
+    pin_thread(t->rx_cpu >= 0 ? t->rx_cpu : t->cpu);
+
+    while (!signal_received) {
+        int tx_done = __atomic_load_n(&t->tx_done, __ATOMIC_ACQUIRE);
+
+        while (ring_pop(&t->sent_ring, &sent))
+            track_sent(k, &sent);
+
+        if (k->pending == 0) {
+            if (tx_done)
+                break;
+            sched_yield();
+            continue;
+        }
+
+        if (receive_packet(t, &end, &seq) < 0)
+            continue;
+
+        /* the reply may have overtaken its ring entry */
+        while (ring_pop(&t->sent_ring, &sent))
+            track_sent(k, &sent);
+
+        inflight_t *p = track_received(k, seq);
+
+        if (!p)
+            continue;
+
+        sample_t smp;
+        make_sample(t, &smp, p, &end);
+
+        while (!ring_push(&t->result_ring, &smp) && !signal_received)
+            sched_yield();
+    }
+
+    __atomic_store_n(&t->rx_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* runs TX and RX in their own threads, the calling thread only does the
+   statistics and the progress output */
+static void run_threaded(test_t *t)
+{
+    pthread_t tx, rx;
+    sample_t smp;
+
+    if (ring_init(&t->sent_ring, MAX_WINDOW + 1, sizeof(inflight_t)) < 0 ||
+        ring_init(&t->result_ring, RESULT_RING_LEN, sizeof(sample_t)) < 0)
+        fatal("out of memory");
+
+    t->tx_done = t->rx_done = 0;
+
+    if (start_thread(&rx, rx_thread, t) != 0)
+        fatal("unable to create RX thread");
+    if (start_thread(&tx, tx_thread, t) != 0)
+        fatal("unable to create TX thread");
+
+    for (;;) {
+        int rx_done = __atomic_load_n(&t->rx_done, __ATOMIC_ACQUIRE);
+
+        while (ring_pop(&t->result_ring, &smp))
+            record_sample(t, &smp);
+
+        if (rx_done)
+            break;
+
+        pace_sleep(1000000, &signal_received);
+    }
+
+    pthread_join(tx, NULL);
+    pthread_join(rx, NULL);
+
+    ring_free(&t->sent_ring);
+    ring_free(&t->result_ring);
+}
+#endif
+
+static void test_init(test_t *t)
+{
+    track_init(&t->track);
+    stats_init(&t->stats, t->window, t->phases, t->rate > 0, t->noise != NULL);
+
+    if (probe_init(&t->probe, t->s->fd, &t->s->wait, t->nr_count, t->framed) < 0)
+        fatal("out of memory");
+
+    if (t->phases)
+        t->probe.gap = &t->stats.phases->gap;
+
+    if (t->out && ring_init(&t->out_ring, OUT_RING_LEN, sizeof(uint64_t)) < 0)
+        fatal("out of memory");
+}
+
+static void test_free(test_t *t)
+{
+    track_free(&t->track);
+    stats_free(&t->stats);
+
+    probe_free(&t->probe);
+    ring_free(&t->out_ring);
+}
+
+/* only the threads that send and receive run on the --harden cpu, the
+   reporter, the statistics of --threads and the pty peers stay off it */
+static void run_test(test_t *t)
+{
+    GetHighResolutionTime(&t->run_begin);
+    pace_anchor(&t->pace, &t->run_begin);
+
+#if defined (HAVE_PTHREAD_H)
+    if (t->threaded) {
+        run_threaded(t);
+    } else
+#endif
+    {
+        if (t->cpu >= 0 && harden_pin(t->cpu) < 0)
+            fatal("unable to pin the sampling to cpu %d", t->cpu);
+
+        run_sequential(t);
+
+        if (t->cpu >= 0)
+            harden_unpin();
+    }
+
+    GetHighResolutionTime(&t->run_end);
+}
+
+#if defined (HAVE_PTHREAD_H)
+static void *port_thread(void *arg)
+{
+    test_t *t = arg;
+
+    pthread_barrier_wait(t->start);
+    run_test(t);
+
+    return NULL;
+}
+
+/* measures all ports at the same time, one thread per port */
+static void run_ports(test_t *tests, int nr_ports)
+{
+    pthread_t *threads = calloc(nr_ports, sizeof *threads);
+    pthread_barrier_t start;
+    int i;
+
+    check_mem(threads);
+    pthread_barrier_init(&start, NULL, nr_ports);
+
+    for (i = 0; i < nr_ports; ++i) {
+        tests[i].start = &start;
+        if (start_thread(&threads[i], port_thread, &tests[i]) != 0)
+            fatal("unable to create thread for %s", tests[i].s->port);
+    }
+
+    for (i = 0; i < nr_ports; ++i)
+        pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&start);
+    free(threads);
+}
+#endif
+
+/* output files of the n-th port get a ".n" suffix in multi-port runs */
+static void port_file_name(char *buf, size_t len, const char *base, int n, int nr_ports)
+{
+    if (nr_ports == 1)
+        snprintf(buf, len, "%s", base);
+    else
+        snprintf(buf, len, "%s.%d", base, n);
+}
+
+static void open_log(test_t *t, const char *path)
+{
+    slog_header_t hdr;
+    struct timeval tv;
+
+    memset(&hdr, 0, sizeof hdr);
+
+    gettimeofday(&tv, NULL);
+
+    hdr.flags = (t->framed ? SLOG_FRAMED : 0) | (t->threaded ? SLOG_THREADED : 0);
+    hdr.baud = t->s->baud;
+    hdr.count = t->nr_count;
+    hdr.window = t->window;
+    hdr.samples = t->nr_samples;
+    hdr.wait_ns = t->wait * 1e6;
+    hdr.start_ns = (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+    snprintf(hdr.port, sizeof hdr.port, "%.127s", t->s->port);
+
+    t->log = slog_create(path, &hdr);
+
+    if (!t->log) {
+        fatal("unable to create sample log '%s'", path);
+    }
+}
+
+static double cpu_time(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+        (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+}
+
+/* the least time a packet can take: a loopback returns each bit as it is
+   sent, so the reply is complete as soon as the packet has been sent */
+static uint64_t wire_ns(const test_t *t)
+{
+    return (uint64_t)t->nr_count * t->s->frame_bits * 1000000000 / t->s->baud;
+}
+
+/* one row of times far below a ms, in us */
+static void print_us_row(const char *name, const histogram_t *h)
+{
+    printf(" %-12s %9.1f %9.1f %9.1f %9.1f\n", name, h->min / 1e3,
+           histogram_percentile(h, 50) / 1e3, histogram_percentile(h, 99) / 1e3,
+           h->max / 1e3);
+}
+
+/* prints the noise floor of the tester measured before the run */
+static void print_calib(const calib_t *c)
+{
+    printf("> noise floor: time stamps %.0f ns, write and read %.1f us", c->stamp_ns,
+           histogram_percentile(&c->syscall, 50) / 1e3);
+    if (c->pty.total)
+        printf(", pty loop %.1f us", histogram_percentile(&c->pty, 50) / 1e3);
+    printf(" (medians)\n");
+
+    if (c->subtract == CALIB_PTY && !c->pty.total)
+        fatal("no pty loop measured to subtract");
+
+    if (c->subtract)
+        printf("> subtracting the %s floor of %.1f us from every sample\n",
+               calib_name(c->subtract), calib_floor(c) / 1e3);
+}
+
+/* prints whether cpu is kept free of other tasks, ticks and the
+   interrupts of the ports, which all show up in the samples otherwise */
+static void print_cpu_conditions(int cpu, const serial_t *ports, int nr_ports)
+{
+    harden_irq_t irqs[16];
+    int isolated = harden_cpu_isolated(cpu);
+    int nohz = harden_cpu_nohz(cpu);
+    int n, i;
+
+    printf("> cpu %d is %s and %s\n", cpu,
+           isolated < 0 ? "maybe isolated" : isolated ? "isolated" : "not isolated",
+           nohz < 0 ? "maybe ticking" : nohz ? "tickless" : "ticking");
+
+    if (isolated == 0)
+        printf("> Warning: other tasks may run on cpu %d, boot with isolcpus=%d\n", cpu, cpu);
+
+    for (n = 0; n < nr_ports; ++n) {
+        int nr = harden_port_irqs(ports[n].port, cpu, irqs, 16);
+
+        for (i = 0; i < nr; ++i) {
+            if (irqs[i].on_cpu > 0)
+                printf("> Warning: irq %d (%s) of %s may be handled on cpu %d\n",
+                       irqs[i].irq, irqs[i].name, ports[n].port, cpu);
+        }
+    }
+}
+
+/* cpu is the tester's cpu time in seconds over the whole run */
+static void print_report(test_t *t, double cpu)
+{
+    stats_t *st = &t->stats;
+    pkt_stats_t *ps = &t->track.ps;
+    int i;
+
+    if (!t->err) {
+        printf("\n> done.\n\n");
+    } else {
+        printf("\n> done (with errors).\n\n");
+    }
+
+    if (st->cnt_a > 0) {
+        printf("> latency distribution:\n\n");
+        report_distribution(&st->hist);
+
+        printf("\n");
+        report_latency(&st->hist);
+        printf(" throughput     was %.1f packets/s\n",
+               st->cnt_a / ConvertTimeDifferenceToSec(&t->run_end, &t->run_begin));
+        printf(" cpu per sample was %.1f us, %.1f%% of one core (%s)\n",
+               cpu * 1e6 / st->cnt_a,
+               100.0 * cpu / ConvertTimeDifferenceToSec(&t->run_end, &t->run_begin),
+               serial_wait_name(t->s->wait.strategy));
+        printf("\n");
+
+        printf("> latency percentiles [ms]:\n\n");
+        report_percentiles(&st->hist);
+        printf("\n");
+    }
+
+    if ((t->wait > 0 || t->rate > 0) && t->pace.err.total > 0) {
+        printf("> pacing: %s gaps of %.3f ms, seed %llu, spin %.0f us, error [ms]:\n\n",
+               pace_name(t->pace.dist), t->pace.gap_ns / 1e6,
+               (unsigned long long)t->pace.seed, t->pace.spin_ns / 1e3);
+        report_percentiles(&t->pace.err);
+        printf("\n");
+    }
+
+    if (st->corrected && st->cnt_a > 0) {
+        static const char *names[] = { "send lag", "raw", "corrected" };
+        const histogram_t *h[] = { st->send_lag, &st->hist, st->corrected };
+
+        printf("> open loop latency at %g packets/s [ms]:\n\n", t->rate);
+        report_percentiles_named(names, h, 3);
+        printf("\n corrected latencies count from when a packet was due to be sent\n");
+        printf("\n");
+    }
+
+    if (st->cnt_a > 0 && wire_ns(t) > 0) {
+        printf("> overhead over the wire time of %.3f ms [ms]:\n\n", wire_ns(t) / 1e6);
+        report_overhead(&st->hist, wire_ns(t));
+        printf("\n");
+    }
+
+    if (t->calib && st->cnt_a > 0) {
+        const calib_t *c = t->calib;
+
+        printf("> noise floor of the tester [us]:\n\n");
+        printf(" %-12s %9s %9s %9s %9s\n", "", "min", "p50", "p99", "max");
+        print_us_row("write+read", &c->syscall);
+        if (c->pty.total)
+            print_us_row("pty loop", &c->pty);
+        printf("\n time stamps cost %.0f ns each", c->stamp_ns);
+        if (t->floor_ns)
+            printf(", %.1f us (%s) were subtracted from every sample",
+                   t->floor_ns / 1e3, calib_name(c->subtract));
+        printf("\n\n");
+    }
+
+    if (st->turnaround.total > 0) {
+        printf("> turnaround of the responder, subtracted from every sample [us]:\n\n");
+        printf(" %-12s %9s %9s %9s %9s\n", "", "min", "p50", "p99", "max");
+        print_us_row("turnaround", &st->turnaround);
+        printf("\n");
+    }
+
+    if (st->noise && st->cnt_a > 0) {
+        noise_stats_t *ns = st->noise;
+        static const char *names[] = { "all", "clean", "disturbed" };
+        const histogram_t *h[] = { &st->hist, &ns->clean, &ns->disturbed };
+        const noise_delta_t *w = &ns->worst;
+
+        printf("> latency of samples the host did or did not disturb [ms]:\n\n");
+        report_percentiles_named(names, h, 3);
+        printf("\n %llu of %llu samples disturbed: %llu preempted, %llu page faulted (%llu major)\n",
+               (unsigned long long)ns->disturbed.total, (unsigned long long)st->cnt_a,
+               (unsigned long long)ns->ivcsw, (unsigned long long)ns->minflt,
+               (unsigned long long)ns->majflt);
+        printf(" port interrupts per sample: %.2f clean, %.2f disturbed\n",
+               ns->clean.total ? (double)ns->irqs_clean / ns->clean.total : 0.0,
+               ns->disturbed.total ? (double)ns->irqs_disturbed / ns->disturbed.total : 0.0);
+        printf(" the worst sample of %.3f ms was %s: %u involuntary and %u voluntary context\n"
+               " switches, %u minor and %u major page faults, %u port interrupts\n\n",
+               ns->worst_ns / 1e6, noise_disturbed(w) ? "disturbed" : "clean",
+               w->ivcsw, w->vcsw, w->minflt, w->majflt, w->irqs);
+    }
+
+    if (st->phases && st->cnt_a > 0) {
+        static const char *names[] = { "write", "first byte", "last byte", "total", "byte gap" };
+        const histogram_t *h[] = {
+            &st->phases->write, &st->phases->first, &st->phases->last, &st->hist, &st->phases->gap
+        };
+
+        printf("> latency phases [ms]:\n\n");
+        report_percentiles_named(names, h, 5);
+        printf("\n");
+    }
+
+    if (t->framed) {
+        printf("> packet accounting:\n\n");
+        printf(" sent       %10lu\n", ps->sent);
+        printf(" received   %10lu\n", ps->received);
+        printf(" lost       %10lu\n", ps->lost);
+        printf(" late       %10lu\n", ps->late);
+        printf(" duplicated %10lu\n", ps->duplicated);
+        printf(" reordered  %10lu\n", ps->reordered);
+        printf(" corrupt    %10lu\n", ps->corrupt);
+        printf("\n");
+    }
+
+    if (t->window > 1 && st->cnt_a > 0) {
+        printf("> latency by window depth:\n\n");
+        printf("   depth  samples      min      max      avg [ms]\n");
+        for (i = 1; i <= t->window; ++i) {
+            depth_stats_t *d = &st->depth_stats[i];
+            if (d->cnt == 0)
+                continue;
+            printf(" %7d %8llu %8.2f %8.2f %8.2f\n", i, (unsigned long long)d->cnt,
+                   d->min, d->max, d->sum / d->cnt);
+        }
+        printf("\n");
+    }
+}
+
+/* prints one line per port and the tester's own cpu usage */
+static void print_ports(test_t *tests, int nr_ports, double cpu, double wall)
+{
+    int i;
+
+    printf("\n> per port results:\n\n");
+    printf(" %-20s %8s %8s %8s %8s %14s %10s\n", "port", "samples", "min", "max", "avg [ms]", "packets/s", "lost");
+
+    for (i = 0; i < nr_ports; ++i) {
+        test_t *t = &tests[i];
+        stats_t *st = &t->stats;
+        printf(" %-20s %8llu %8.2f %8.2f %8.2f %14.1f %10lu%s\n", t->s->port,
+               (unsigned long long)st->cnt_a,
+               st->cnt_a ? st->hist.min / 1e6 : 0.0, st->hist.max / 1e6, st->hist.mean / 1e6,
+               st->cnt_a / ConvertTimeDifferenceToSec(&t->run_end, &t->run_begin),
+               t->track.ps.lost, t->err ? " (errors)" : "");
+    }
+
+    printf("\n> tester used %.1f%% cpu, %.1f%% per port\n", 100.0 * cpu / wall, 100.0 * cpu / wall / nr_ports);
+}
+
+#if defined (HAVE_PTHREAD_H)
+/* --bulk: a byte pattern streamed over the loopback as fast as it goes,
+   byte n of the stream is n & 0xff */
+typedef struct {
+    serial_t *s;
+    int block;
+    double duration;
+    uint64_t tx_bytes;          /* written so far, read by the RX side */
+    unsigned long stalls;       /* writes that found the output buffer full */
+    uint64_t stall_ns;          /* time blocked in those writes */
+    int tx_done, err;
+} bulk_t;
+
+/* whether the output buffer of the port has room left */
+static int port_writable(PORTTYPE fd)
+{
+#if defined (_WIN32)
+    return 1;
+#else
+    fd_set fds;
+    struct timeval t = { 0, 0 };
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    return select(fd + 1, NULL, &fds, NULL, &t) != 0;
+#endif
+}
+
+static void *bulk_tx_thread(void *arg)
+{
+    bulk_t *b = arg;
+    uint8_t *buf = malloc(b->block + 256);
+    timerStruct begin, now, done;
+    uint64_t sent = 0;
+    int i;
+
+    check_mem(buf);
+
+    for (i = 0; i < b->block + 256; ++i)
+        buf[i] = i & 0xff;
+
+    GetHighResolutionTime(&begin);
+
+    while (!signal_received) {
+        GetHighResolutionTime(&now);
+        if (ConvertTimeDifferenceToSec(&now, &begin) >= b->duration)
+            break;
+
+        int full = !port_writable(b->s->fd);
+
+        /* one large write per block, starting where the pattern stopped */
+        if (serial_write(b->s->fd, buf + (sent & 0xff), b->block) != b->block) {
+            b->err = 1;
+            break;
+        }
+
+        if (full) {
+            GetHighResolutionTime(&done);
+            b->stalls++;
+            b->stall_ns += ConvertTimeDifferenceToNs(&done, &now);
+        }
+
+        sent += b->block;
+        __atomic_store_n(&b->tx_bytes, sent, __ATOMIC_RELEASE);
+    }
+
+    free(buf);
+    __atomic_store_n(&b->tx_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* streams the pattern for duration seconds in blocks of given size and
+   reads it back at the same time, printing the throughput every second */
+static int run_bulk(serial_t *s, int block, double duration)
+{
+    static uint8_t buf[65536];
+    double limit = (double)s->baud / s->frame_bits;
+    uint64_t rx_bytes = 0, last_tx = 0, last_rx = 0;
+    unsigned long breaks = 0, last_stalls = 0;
+    uint8_t shift = 0;
+    timerStruct begin, now;
+    double next = 1, cpu_begin = cpu_time();
+    pthread_t tx;
+    bulk_t b;
+    int i, err = 0;
+
+    memset(&b, 0, sizeof b);
+    b.s = s;
+    b.block = block;
+    b.duration = duration;
+
+    printf("\n> streaming %d byte blocks for %g s, the wire limit is %.0f bytes/s - please wait..\n",
+           block, duration, limit);
+    printf("      time    tx [bytes/s]    rx [bytes/s] efficiency   stalls\n");
+
+    GetHighResolutionTime(&begin);
+
+    if (start_thread(&tx, bulk_tx_thread, &b) != 0)
+        fatal("unable to create TX thread");
+
+    for (;;) {
+        int tx_done = __atomic_load_n(&b.tx_done, __ATOMIC_ACQUIRE);
+        int n = serial_read_any(s->fd, &s->wait, buf, sizeof buf);
+
+        if (n < 0) {
+            fprintf(stderr, "serial_read() n = %d\n", n);
+            err = 1;
+            break;
+        }
+
+        /* a lost or corrupt byte breaks the pattern, pick it up again */
+        for (i = 0; i < n; ++i) {
+            uint8_t expect = (uint8_t)(rx_bytes + i) + shift;
+            if (buf[i] != expect) {
+                breaks++;
+                shift += buf[i] - expect;
+            }
+        }
+
+        rx_bytes += n;
+
+        GetHighResolutionTime(&now);
+        double secs = ConvertTimeDifferenceToSec(&now, &begin);
+        uint64_t tx_bytes = __atomic_load_n(&b.tx_bytes, __ATOMIC_ACQUIRE);
+
+        if (secs >= next) {
+            unsigned long stalls = b.stalls;
+            printf(" %9.0f %15.0f %15.0f %9.1f%% %8lu\n", next,
+                   (double)(tx_bytes - last_tx), (double)(rx_bytes - last_rx),
+                   100.0 * (rx_bytes - last_rx) / limit, stalls - last_stalls);
+            last_tx = tx_bytes;
+            last_rx = rx_bytes;
+            last_stalls = stalls;
+            next = floor(secs) + 1;
+        }
+
+        if (tx_done && (rx_bytes >= tx_bytes || n == 0))
+            break;
+        if (interrupted && n == 0)
+            break;
+    }
+
+    pthread_join(tx, NULL);
+
+    GetHighResolutionTime(&now);
+
+    double secs = ConvertTimeDifferenceToSec(&now, &begin);
+    double cpu = cpu_time() - cpu_begin;
+
+    err |= b.err;
+
+    printf("\n> done%s.\n\n", err ? " (with errors)" : "");
+    printf("> bulk throughput:\n\n");
+    printf(" sent           %12llu bytes\n", (unsigned long long)b.tx_bytes);
+    printf(" received       %12llu bytes\n", (unsigned long long)rx_bytes);
+    printf(" lost           %12lld bytes\n", (long long)(b.tx_bytes - rx_bytes));
+    printf(" pattern breaks %12lu\n", breaks);
+    printf(" throughput     %12.0f bytes/s\n", rx_bytes / secs);
+    printf(" wire limit     %12.0f bytes/s (%d baud, %d bits per byte)\n", limit, s->baud, s->frame_bits);
+    printf(" efficiency     %12.1f %%\n", 100.0 * rx_bytes / secs / limit);
+    printf(" stalls         %12lu writes found the output buffer full, blocked %.3f s\n",
+           b.stalls, b.stall_ns / 1e9);
+    printf(" tester cpu     %12.1f %%\n\n", 100.0 * cpu / secs);
+
+    return err || b.tx_bytes != rx_bytes || breaks ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+#endif
+
+/* returns what arrives on the port right away until interrupted. With
+   stamp, it returns whole framed packets of len bytes instead, with the
+   time from reading their last byte to writing them back put into them. */
+static int run_echo(serial_t *s, int len, int stamp)
+{
+    static uint8_t buf[65536];
+    static histogram_t turnaround;
+    unsigned long long bytes = 0;
+    unsigned long packets = 0, corrupt = 0;
+    int have = 0, err = 0;
+
+    if (stamp && len > (int)sizeof buf)
+        fatal("--echo=stamp takes packets of up to %d bytes", (int)sizeof buf);
+
+    histogram_reset(&turnaround);
+
+    printf("\n> echoing %s on %s until interrupted..\n",
+           stamp ? "framed packets with their turnaround" : "all bytes", s->port);
+
+    while (!signal_received) {
+        int n = serial_read_any(s->fd, &s->wait, buf + have, (stamp ? len : sizeof buf) - have);
+        timerStruct in, out;
+
+        GetHighResolutionTime(&in);
+
+        if (n < 0) {
+            fprintf(stderr, "serial_read() n = %d\n", n);
+            err = 1;
+            break;
+        }
+
+        if (n == 0)
+            continue;
+
+        if (!stamp) {
+            if (serial_write(s->fd, buf, n) != n) {
+                fprintf(stderr, "serial_write() failed\n");
+                err = 1;
+                break;
+            }
+            bytes += n;
+            continue;
+        }
+
+        have += n;
+        if (have < len)
+            continue;
+
+        uint32_t seq;
+        uint64_t ts;
+
+        if (packet_decode(buf, len, &seq, &ts) < 0) {
+            /* resynchronise on the next sync byte, the initiator sees a
+               lost packet */
+            int i = 1;
+            while (i < len && buf[i] != PACKET_SYNC) i++;
+            have = len - i;
+            memmove(buf, buf + i, have);
+            corrupt++;
+            continue;
+        }
+
+        GetHighResolutionTime(&out);
+
+        uint64_t ns = ConvertTimeDifferenceToNs(&out, &in);
+
+        packet_set_turnaround(buf, len, ns);
+
+        if (serial_write(s->fd, buf, len) != len) {
+            fprintf(stderr, "serial_write() failed\n");
+            err = 1;
+            break;
+        }
+
+        histogram_add(&turnaround, ns);
+        bytes += len;
+        packets++;
+        have = 0;
+    }
+
+    printf("\n> done%s.\n\n", err ? " (with errors)" : "");
+    printf("> echoed %llu bytes", bytes);
+    if (stamp)
+        printf(" in %lu packets, %lu corrupt ones dropped", packets, corrupt);
+    printf("\n\n");
+
+    if (turnaround.total > 0) {
+        printf("> turnaround [us]:\n\n");
+        printf(" %-12s %9s %9s %9s %9s\n", "", "min", "p50", "p99", "max");
+        print_us_row("turnaround", &turnaround);
+        printf("\n");
+    }
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static long online_cpus(void)
+{
+    long n = 1;
+
+#if defined (_SC_NPROCESSORS_ONLN)
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+#endif
+
+    return n;
+}
+
+/* prints the statistics over all samples in the given files */
+static int run_analyze(char **files, int nr_files)
+{
+    histogram_t *h = malloc(sizeof *h);
+    long jobs = online_cpus();
+    uint64_t bytes = 0;
+    int i, err = 0;
+
+    check_mem(h);
+    histogram_reset(h);
+
+    printf("\n> analyzing %d file%s with up to %ld threads..\n", nr_files, nr_files == 1 ? "" : "s", jobs);
+
+    timerStruct begin, end;
+    GetHighResolutionTime(&begin);
+
+    for (i = 0; i < nr_files; ++i) {
+        analyze_result_t res;
+
+        if (analyze_file(files[i], h, jobs, &res) < 0) {
+            fprintf(stderr, "> unable to analyze %s\n", files[i]);
+            err = 1;
+            continue;
+        }
+
+        bytes += res.bytes;
+
+        printf("> %s: %llu samples (%s)", files[i], (unsigned long long)res.samples,
+               res.binary ? "sample log" : "text");
+        if (res.invalid)
+            printf(", %llu invalid lines", (unsigned long long)res.invalid);
+        printf("\n");
+    }
+
+    GetHighResolutionTime(&end);
+
+    double secs = ConvertTimeDifferenceToSec(&end, &begin);
+
+    printf("\n> done, %llu samples in %.2f s (%.0f MB/s).\n\n", (unsigned long long)h->total,
+           secs, bytes / 1e6 / secs);
+
+    if (h->total > 0) {
+        printf("> latency distribution:\n\n");
+        report_distribution(h);
+        printf("\n");
+        report_latency(h);
+        printf("\n");
+        printf("> latency percentiles [ms]:\n\n");
+        report_percentiles(h);
+        printf("\n");
+    }
+
+    free(h);
+
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* compares the samples of a new run with those of a baseline run */
+static int run_compare(const char *base, const char *cur, double tail, double threshold)
+{
+    const char *files[2] = { base, cur };
+    histogram_t *h = malloc(2 * sizeof *h);
+    int i, ret;
+
+    check_mem(h);
+
+    printf("\n");
+
+    for (i = 0; i < 2; ++i) {
+        analyze_result_t res;
+
+        histogram_reset(&h[i]);
+
+        if (analyze_file(files[i], &h[i], online_cpus(), &res) < 0) {
+            fprintf(stderr, "> unable to analyze %s\n", files[i]);
+            free(h);
+            return EXIT_FAILURE;
+        }
+
+        printf("> %s %s: %llu samples\n", i ? "new " : "base", files[i], (unsigned long long)res.samples);
+
+        if (res.samples == 0) {
+            free(h);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("\n");
+
+    ret = compare_report(&h[0], &h[1], tail, threshold) ? 2 : EXIT_SUCCESS;
+
+    printf("\n");
+
+    free(h);
+
+    return ret;
+}
+
+/* parses a time like 50us, 250ms, 90, 90s, 30m, 12h or 3d into seconds,
+   inf gives 0 */
+static double parse_time(const char *arg)
+{
+    char *end;
+    double v;
+
+    if (!strcmp(arg, "inf"))
+        return 0;
+
+    v = strtod(arg, &end);
+
+    if (end == arg || v < 0)
+        fatal("invalid time '%s'", arg);
+
+    if (!strcmp(end, "us"))
+        v /= 1000000;
+    else if (!strcmp(end, "ms"))
+        v /= 1000;
+    else if (!strcmp(end, "m") || !strcmp(end, "min"))
+        v *= 60;
+    else if (!strcmp(end, "h"))
+        v *= 3600;
+    else if (!strcmp(end, "d"))
+        v *= 86400;
+    else if (*end && strcmp(end, "s"))
+        fatal("invalid time '%s'", arg);
+
+    return v;
+}
+
+/* one cell of the --sweep matrix */
+typedef struct {
+    int baud, count, err;
+    unsigned long lost;
+    double packets_per_s;
+    uint64_t wire_ns;
+    histogram_t hist;
+} sweep_cell_t;
+
+static void print_sweep_csv(FILE *f, const sweep_cell_t *c, int n)
+{
+    int i;
+
+    fprintf(f, "baud,bytes,samples,lost,min_ms,avg_ms,p50_ms,p90_ms,p99_ms,p99.9_ms,max_ms,"
+            "wire_ms,p50_over_wire,packets_per_s,bytes_per_s,errors\n");
+
+    for (i = 0; i < n; ++i, ++c) {
+        const histogram_t *h = &c->hist;
+        fprintf(f, "%d,%d,%llu,%lu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%.1f,%.1f,%d\n",
+                c->baud, c->count, (unsigned long long)h->total, c->lost,
+                h->total ? h->min / 1e6 : 0.0, h->mean / 1e6,
+                histogram_percentile(h, 50) / 1e6, histogram_percentile(h, 90) / 1e6,
+                histogram_percentile(h, 99) / 1e6, histogram_percentile(h, 99.9) / 1e6,
+                h->max / 1e6, c->wire_ns / 1e6,
+                c->wire_ns ? (double)histogram_percentile(h, 50) / c->wire_ns : 0.0,
+                c->packets_per_s, c->packets_per_s * c->count, c->err);
+    }
+}
+
+static void print_sweep_json(FILE *f, const sweep_cell_t *c, int n)
+{
+    int i;
+
+    fprintf(f, "[\n");
+
+    for (i = 0; i < n; ++i, ++c) {
+        const histogram_t *h = &c->hist;
+        fprintf(f, "  {\"baud\": %d, \"bytes\": %d, \"samples\": %llu, \"lost\": %lu, "
+                "\"min_ms\": %.4f, \"avg_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, "
+                "\"p99_ms\": %.4f, \"p99.9_ms\": %.4f, \"max_ms\": %.4f, \"wire_ms\": %.4f, "
+                "\"p50_over_wire\": %.3f, \"packets_per_s\": %.1f, \"bytes_per_s\": %.1f, "
+                "\"errors\": %s}%s\n",
+                c->baud, c->count, (unsigned long long)h->total, c->lost,
+                h->total ? h->min / 1e6 : 0.0, h->mean / 1e6,
+                histogram_percentile(h, 50) / 1e6, histogram_percentile(h, 90) / 1e6,
+                histogram_percentile(h, 99) / 1e6, histogram_percentile(h, 99.9) / 1e6,
+                h->max / 1e6, c->wire_ns / 1e6,
+                c->wire_ns ? (double)histogram_percentile(h, 50) / c->wire_ns : 0.0,
+                c->packets_per_s, c->packets_per_s * c->count, c->err ? "true" : "false",
+                i + 1 < n ? "," : "");
+    }
+
+    fprintf(f, "]\n");
+}
+
+/* measures every combination of the given baud rates and packet sizes on
+   the port of tmpl, reconfiguring it in between, for at most samples
+   samples or seconds s each, whichever comes first, and writes the matrix
+   to f as CSV or JSON */
+static int run_sweep(const test_t *tmpl, const int *bauds, int nr_bauds,
+                     const int *counts, int nr_counts, int samples, double seconds,
+                     int json, FILE *f)
+{
+    serial_t *s = tmpl->s;
+    sweep_cell_t *cells = calloc(nr_bauds * nr_counts, sizeof *cells);
+    calib_t *calib = NULL;
+    int b, c, n = 0, err = 0;
+
+    check_mem(cells);
+
+    /* the floor depends on the packet size, --subtract takes the one of
+       each combination rather than that of -c and -b */
+    if (tmpl->calib && tmpl->calib->subtract) {
+        calib = malloc(sizeof *calib);
+        check_mem(calib);
+        calib->subtract = tmpl->calib->subtract;
+    }
+
+    printf("\n> sweeping %d baud rates and %d packet sizes, %d samples or %.1f s each - please wait..\n",
+           nr_bauds, nr_counts, samples, seconds);
+    if (calib)
+        printf("> measuring the %s floor to subtract for each of them\n", calib_name(calib->subtract));
+    printf("     baud    bytes  samples      min      p50      p99    p99.9      max [ms]\n");
+
+    for (b = 0; b < nr_bauds && !interrupted; ++b) {
+        if (serial_set_baud(s->fd, bauds[b]) < 0) {
+            fprintf(stderr, "> %s does not support %d baud, skipping it.\n", s->port, bauds[b]);
+            continue;
+        }
+
+        s->baud = bauds[b];
+
+        for (c = 0; c < nr_counts && !interrupted; ++c) {
+            sweep_cell_t *cell = &cells[n++];
+            test_t t = *tmpl;
+
+            t.nr_count = counts[c];
+            t.nr_samples = samples;
+            t.duration = seconds;
+            if (t.framed && t.nr_count < PACKET_MIN_LEN)
+                t.nr_count = PACKET_MIN_LEN;
+
+            /* vmin waits for whole packets */
+            serial_wait_free(&s->wait);
+            if (serial_wait_init(s->fd, &s->wait, s->wait.strategy, t.nr_count) < 0)
+                fatal("Unable to set up waiting on %s", s->port);
+
+            if (calib) {
+                calib_run(calib, s->wait.strategy, bauds[b], t.nr_count, CALIB_ROUNDS);
+                t.calib = calib;
+                t.floor_ns = calib_floor(calib);
+            }
+
+            serial_flush(s->fd);
+
+            test_init(&t);
+            run_test(&t);
+
+            cell->baud = bauds[b];
+            cell->count = t.nr_count;
+            cell->err = t.err;
+            cell->lost = t.track.ps.lost;
+            cell->wire_ns = wire_ns(&t);
+            cell->packets_per_s = t.stats.cnt_a / ConvertTimeDifferenceToSec(&t.run_end, &t.run_begin);
+            cell->hist = t.stats.hist;
+
+            printf(" %8d %8d %8llu %8.3f %8.3f %8.3f %8.3f %8.3f%s\n", cell->baud, cell->count,
+                   (unsigned long long)t.stats.cnt_a, t.stats.cnt_a ? t.stats.hist.min / 1e6 : 0.0,
+                   histogram_percentile(&cell->hist, 50) / 1e6,
+                   histogram_percentile(&cell->hist, 99) / 1e6,
+                   histogram_percentile(&cell->hist, 99.9) / 1e6,
+                   cell->hist.max / 1e6, t.err ? " (errors)" : "");
+
+            err |= t.err;
+            test_free(&t);
+
+            /* go on with the next cell after errors */
+            signal_received = interrupted;
+        }
+    }
+
+    if (f == stdout)
+        printf("\n");
+
+    if (json)
+        print_sweep_json(f, cells, n);
+    else
+        print_sweep_csv(f, cells, n);
 
-static void fatal(const char *msg, ...)
-{
-    va_list ap;
+    free(cells);
+    free(calib);
 
-    va_start(ap, msg);
-    vfprintf(stderr, msg, ap);
-    va_end(ap);
-    fprintf(stderr, ". Exiting.\n\n");
-    exit(EXIT_FAILURE);
+    return err ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-/* memory allocation error handling */
-static void check_mem(void *p)
+static void close_ports(test_t *tests, serial_t *ports, int nr_ports)
 {
-    if (!p)
-        fatal("out of memory");
-}
+    int n;
 
-#if defined (HAVE_SYS_UTSNAME_H)
-void print_uname()
-{
-    struct utsname u;
-    uname (&u);
-    printf ("> running on %s release %s (version %s) on %s\n",
-            u.sysname, u.release, u.version, u.machine);
-}
-#endif
+    for (n = 0; n < nr_ports; ++n) {
+        serial_t *s = &ports[n];
 
-/* sets the process to "policy" policy at given priority */
-static int set_realtime_priority(int policy, int prio)
-{
-#if defined (HAVE_SCHED_H)
-    struct sched_param schp;
-    memset(&schp, 0, sizeof(schp));
+        if (tests[n].noise) {
+            noise_free(tests[n].noise);
+            free(tests[n].noise);
+        }
 
-    schp.sched_priority = prio;
-    if (sched_setscheduler(0, policy, &schp) != 0) {
-        perror("sched_setscheduler");
-        return -1;
-    }
-#endif
+        breaktrace_free(&tests[n]);
 
-    return 0;
-}
+        test_free(&tests[n]);
+        serial_wait_free(&s->wait);
 
-static void usage(const char *argv0)
-{
-    printf("Usage: %s -p <port> ...\n\n"
-           "  -p, --port=port    serial port to run tests on\n"
-           "  -b, --baud=baud    baud rate (default: 9600)\n"
-#if defined (HAVE_SCHED_H)
-           "  -R, --realtime     use realtime scheduling (default: no)\n"
-           "  -P, --priority=n   scheduling priority, use with -R\n"
-           "                     (default: 99)\n\n"
-#endif
-           "  -S, --samples=n    to take for the measurement (default: 10000)\n"
-           "  -c, --count=n      number of bytes to send per sample (default: 1)\n"
-           "  -w, --wait=ms      time interval between measurements (default: 0)\n"
-           "  -r, --random-wait  use random interval between wait and 2*wait\n\n"
-#if defined (HAVE_LINUX_SERIAL_H)
-#if defined (ASYNC_LOW_LATENCY)
-           "  -a, --async        set ASYNC_LOW_LATENCY flag (default: no)\n"
-#endif
-           "  -x  --xmit=n       set xmit_fifo_size to given number (default: 0)\n"
+#if defined(HAVE_TERMIOS_H)
+        serial_close(s->fd, &s->opts);
+#else
+        serial_close(s->fd);
 #endif
-           "  -o, --output=file  write the output to file\n\n"
-           "  -h, --help         this help\n"
-           "  -V, --version      print current version\n\n"
-           "Report bugs to Jakob Flierl <jakob.flierl@gmail.com>\n"
-           "Website and manual: https://github.com/koppi/serial-latency-test\n"
-           "\n", argv0);
+    }
+
+    free(tests);
+    free(ports);
 }
 
-static void print_version(void)
+/* parses a comma separated list of positive numbers */
+static int parse_list(const char *list, int *vals, int max)
 {
-    printf("%s version %s\n", PACKAGE, VERSION);
+    char buf[1024];
+    char *save, *tok, *end;
+    int n = 0;
+
+    snprintf(buf, sizeof buf, "%s", list);
+
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (n >= max)
+            fatal("at most %d values are supported in '%s'", max, list);
+        vals[n] = strtol(tok, &end, 10);
+        if (*end || vals[n] <= 0)
+            fatal("invalid number '%s' in '%s'", tok, list);
+        n++;
+    }
+
+    return n;
 }
 
-#if defined (_WIN32)
-static void wait_ms(unsigned long t)
+static emu_t emu;
+
+static void stop_emulator(void)
 {
-    Sleep(t);
+    emulate_stop(&emu);
 }
-#else
-static void wait_ms(unsigned long msec)
+
+/* parses the threshold of --breaktrace and its options before=n, after=n,
+   keep and file=path */
+static void parse_breaktrace(breaktrace_t *bt, char *path, size_t len, const char *arg)
 {
-	struct timespec timeout0;
-	struct timespec timeout1;
-	struct timespec* tmp;
-	struct timespec* t0 = &timeout0;
-	struct timespec* t1 = &timeout1;
+    char buf[PATH_MAX + 64];
+    char *save, *tok;
 
-	t0->tv_sec = msec / 1000;
-	t0->tv_nsec = (msec % 1000) * (1000 * 1000);
+    snprintf(buf, sizeof buf, "%s", arg);
 
-	while (nanosleep(t0, t1) == -1 && errno == EINTR) {
-		tmp = t0;
-		t0 = t1;
-		t1 = tmp;
-	}
-}
-#endif
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
 
-/* many thanks to Randall Munroe (http://xkcd.com/221/) */
-static int getRandomNumber(void)
-{
-    return 4; // chosen by fair dice roll.
-              // guaranteed to be random.
+        if (tok == buf) {
+            bt->threshold_ns = parse_time(tok) * 1e9;
+            continue;
+        }
+
+        if (!strcmp(tok, "keep")) {
+            bt->keep = 1;
+            continue;
+        }
+
+        if (!val)
+            fatal("invalid breaktrace option '%s'", tok);
+        *val++ = 0;
+
+        if (!strcmp(tok, "before"))
+            bt->before = atoi(val);
+        else if (!strcmp(tok, "after"))
+            bt->after = atoi(val);
+        else if (!strcmp(tok, "file"))
+            snprintf(path, len, "%s", val);
+        else
+            fatal("unknown breaktrace option '%s'", tok);
+    }
+
+    if (bt->threshold_ns == 0)
+        fatal("the breaktrace threshold must be greater than zero");
+    if (bt->before < 0 || bt->after < 0 || bt->before + bt->after > 1000000)
+        fatal("keep between 0 and 1000000 samples around a breaktrace");
 }
 
-static void sighandler(int sig)
+/* parses a link model like delay=100us,jitter=50us,dist=exp,batch=1ms,loss=0.1 */
+static void parse_emulate(emu_model_t *m, const char *arg)
 {
-	if (!signal_received)
-		fprintf(stderr,"\n\n> caught signal - shutting down.\n");
-    signal_received = 1;
+    char buf[256];
+    char *save, *tok;
+
+    snprintf(buf, sizeof buf, "%s", arg);
+
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *val = strchr(tok, '=');
+
+        if (!val)
+            fatal("invalid link model '%s'", tok);
+        *val++ = 0;
+
+        if (!strcmp(tok, "delay"))
+            m->delay_ns = parse_time(val) * 1e9;
+        else if (!strcmp(tok, "jitter"))
+            m->jitter_ns = parse_time(val) * 1e9;
+        else if (!strcmp(tok, "batch"))
+            m->batch_ns = parse_time(val) * 1e9;
+        else if (!strcmp(tok, "loss"))
+            m->loss = atof(val) / 100;
+        else if (!strcmp(tok, "dist")) {
+            m->jitter_dist = pace_parse(val);
+            if (m->jitter_dist < 0)
+                fatal("unknown jitter distribution '%s'", val);
+        } else
+            fatal("unknown link model parameter '%s'", tok);
+    }
 }
 
-typedef struct {
-    PORTTYPE fd;
-    int  baud;
-    char port[PATH_MAX];
-#if defined (HAVE_TERMIOS_H)
-    struct termios opts;
-#endif
-} serial_t;
+/* adds the comma separated ports in list */
+static void add_ports(serial_t *ports, int *nr_ports, const char *list)
+{
+    char buf[PATH_MAX * 4];
+    char *save, *tok;
 
-int digits(double number) {
-    int digits = 1, pten = 10;
+    snprintf(buf, sizeof buf, "%s", list);
 
-    while (pten <= number) {
-        digits++; pten *= 10;
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (*nr_ports >= MAX_PORTS)
+            fatal("at most %d ports are supported", MAX_PORTS);
+        snprintf(ports[*nr_ports].port, sizeof ports[*nr_ports].port, "%s", tok);
+        (*nr_ports)++;
     }
-
-    return digits;
 }
 
 int main(int argc, char *argv[])
@@ -233,6 +2584,13 @@ int main(int argc, char *argv[])
         {"count", required_argument, NULL, 'c'},
         {"wait", required_argument, NULL, 'w'},
         {"random-wait", no_argument, NULL, 'r'},
+        {"window", required_argument, NULL, OPT_WINDOW},
+        {"framed", no_argument, NULL, OPT_FRAMED},
+#if defined (HAVE_PTHREAD_H)
+        {"threads", no_argument, NULL, OPT_THREADS},
+        {"tx-cpu", required_argument, NULL, OPT_TX_CPU},
+        {"rx-cpu", required_argument, NULL, OPT_RX_CPU},
+#endif
 #if defined (HAVE_LINUX_SERIAL_H)
 #if defined (ASYNC_LOW_LATENCY)
         {"async", no_argument, NULL, 'a'},
@@ -240,6 +2598,33 @@ int main(int argc, char *argv[])
         {"xmit", required_argument, NULL, 'x'},
 #endif
         {"output", required_argument, NULL, 'o'},
+        {"log", required_argument, NULL, OPT_LOG},
+        {"duration", required_argument, NULL, OPT_DURATION},
+        {"interval", required_argument, NULL, OPT_INTERVAL},
+        {"analyze", no_argument, NULL, OPT_ANALYZE},
+        {"compare", no_argument, NULL, OPT_COMPARE},
+        {"tail", required_argument, NULL, OPT_TAIL},
+        {"threshold", required_argument, NULL, OPT_THRESHOLD},
+        {"wait-strategy", required_argument, NULL, OPT_WAIT_STRATEGY},
+        {"clock", required_argument, NULL, OPT_CLOCK},
+        {"phases", no_argument, NULL, OPT_PHASES},
+        {"sweep", optional_argument, NULL, OPT_SWEEP},
+        {"bulk", no_argument, NULL, OPT_BULK},
+        {"rate", required_argument, NULL, OPT_RATE},
+        {"pace", required_argument, NULL, OPT_PACE},
+        {"seed", required_argument, NULL, OPT_SEED},
+        {"spin", required_argument, NULL, OPT_SPIN},
+        {"emulate", optional_argument, NULL, OPT_EMULATE},
+        {"subtract", optional_argument, NULL, OPT_SUBTRACT},
+        {"echo", optional_argument, NULL, OPT_ECHO},
+        {"harden", optional_argument, NULL, OPT_HARDEN},
+        {"noise", no_argument, NULL, OPT_NOISE},
+        {"breaktrace", required_argument, NULL, OPT_BREAKTRACE},
+        {"loss-timeout", required_argument, NULL, OPT_LOSS_TIMEOUT},
+        {"sweep-baud", required_argument, NULL, OPT_SWEEP_BAUD},
+        {"sweep-count", required_argument, NULL, OPT_SWEEP_COUNT},
+        {"sweep-samples", required_argument, NULL, OPT_SWEEP_SAMPLES},
+        {"sweep-time", required_argument, NULL, OPT_SWEEP_TIME},
         {}
     };
 
@@ -254,18 +2639,64 @@ int main(int argc, char *argv[])
     int xmit_fifo_size = 0;
 #endif
     int nr_samples = 10000;
+    int samples_given = 0;
+    int count_given = 0;
+    int bulk = 0;
+    int window_given = 0;
+    double rate = 0;
+    int pace = -1;
+    uint64_t seed = 0;
+    int seed_given = 0;
+    double spin_us = 0;
+    int emulate = 0;
+    static calib_t calib;
+    int echo = 0, echo_stamp = 0;
+    int harden = 0, harden_cpu = -1;
+    int noise = 0;
+    breaktrace_t bt_cfg = { .before = 100 };
+    char bt_file[PATH_MAX] = "breaktrace.txt";
+    int breaktrace = 0;
+    emu_model_t model;
+
+    memset(&model, 0, sizeof model);
+    model.jitter_dist = PACE_UNIFORM;
+    int soak = 0;
+    int analyze = 0;
+    int compare = 0;
+    double tail = 99.9;
+    double threshold = 10;
+    int wait_strategy = SERIAL_WAIT_SELECT;
+    int use_tsc = 1;
+    int phases = 0;
+    int sweep = 0, sweep_json = 0;
+    int sweep_bauds[MAX_SWEEP] = { 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600 };
+    int nr_sweep_bauds = 8;
+    int sweep_samples = SWEEP_SAMPLES;
+    double sweep_time = SWEEP_TIME;
+    int sweep_counts[MAX_SWEEP] = { 1, 16, 64, 256 }, nr_sweep_counts = 4;
+    double duration = 0;
+    double interval = -1;
     int nr_count = 1;
     int random_wait = 0;
+    int window = 1;
+    int framed = 0;
+    double loss_timeout = 0;
+#if defined (HAVE_PTHREAD_H)
+    int threaded = 0;
+    int tx_cpu = -1, rx_cpu = -1;
+#endif
     double wait = 0.0;
     char output[PATH_MAX];
+    char log[PATH_MAX];
 
-    serial_t s;
+    serial_t *ports = calloc(MAX_PORTS, sizeof *ports);
+    int nr_ports = 0;
+    int baud = 9600;
 
-    s.fd   = 0;
-    s.baud = 9600;
-    snprintf(s.port, sizeof s.port, "%s", "");
+    check_mem(ports);
 
     snprintf(output, sizeof output, "%s", "");
+    snprintf(log, sizeof log, "%s", "");
 
     int c;
 
@@ -303,10 +2734,10 @@ int main(int argc, char *argv[])
             break;
 #endif
         case 'p':
-            strncpy(s.port, optarg, sizeof(s.port));
+            add_ports(ports, &nr_ports, optarg);
             break;
         case 'b':
-            s.baud = strtol(optarg, NULL, 10);
+            baud = strtol(optarg, NULL, 10);
             break;
 #if defined (HAVE_SCHED_H)
         case 'P':
@@ -324,6 +2755,7 @@ int main(int argc, char *argv[])
 #endif
         case 'S':
             nr_samples = atoi(optarg);
+            samples_given = 1;
             if (nr_samples <= 0) {
                 printf("> Warning: Given number of samples to take is less or equal zero! ");
                 printf("Setting nr of samples to take to 1.\n");
@@ -332,6 +2764,12 @@ int main(int argc, char *argv[])
             break;
         case 'c':
             nr_count = atoi(optarg);
+            count_given = 1;
+            if (nr_count <= 0) {
+                printf("> Warning: Given number of bytes per sample is less or equal zero! ");
+                printf("Setting nr of bytes per sample to 1.\n");
+                nr_count = 1;
+            }
             break;
         case 'w':
             wait = atof(optarg);
@@ -353,20 +2791,254 @@ int main(int argc, char *argv[])
         case 'r':
             random_wait = 1;
             break;
+        case OPT_WINDOW:
+            window_given = 1;
+            window = atoi(optarg);
+            if (window < 1 || window > MAX_WINDOW) {
+                printf("> Warning: Window must be between 1 and %d! ", MAX_WINDOW);
+                window = RAIL(window, 1, MAX_WINDOW);
+                printf("Setting window to %d.\n", window);
+            }
+            break;
+        case OPT_FRAMED:
+            framed = 1;
+            break;
+        case OPT_LOSS_TIMEOUT:
+            loss_timeout = parse_time(optarg);
+            if (loss_timeout <= 0)
+                fatal("the loss timeout must be greater than zero");
+            break;
+#if defined (HAVE_PTHREAD_H)
+        case OPT_THREADS:
+            threaded = 1;
+            break;
+        case OPT_TX_CPU:
+            tx_cpu = atoi(optarg);
+            break;
+        case OPT_RX_CPU:
+            rx_cpu = atoi(optarg);
+            break;
+#endif
         case 'o':
             strncpy(output, optarg, sizeof(output));
             break;
+        case OPT_LOG:
+            snprintf(log, sizeof log, "%s", optarg);
+            break;
+        case OPT_DURATION:
+            duration = parse_time(optarg);
+            soak = 1;
+            break;
+        case OPT_ANALYZE:
+            analyze = 1;
+            break;
+        case OPT_COMPARE:
+            compare = 1;
+            break;
+        case OPT_TAIL:
+            tail = atof(optarg);
+            if (tail <= 0 || tail > 100)
+                fatal("the tail percentile must be within 0 .. 100");
+            break;
+        case OPT_THRESHOLD:
+            threshold = atof(optarg);
+            break;
+        case OPT_WAIT_STRATEGY:
+            wait_strategy = serial_wait_parse(optarg);
+            if (wait_strategy < 0)
+                fatal("unknown or unsupported wait strategy '%s'", optarg);
+            break;
+        case OPT_SWEEP:
+            sweep = 1;
+            if (optarg && !strcmp(optarg, "json"))
+                sweep_json = 1;
+            else if (optarg && strcmp(optarg, "csv"))
+                fatal("unknown sweep format '%s'", optarg);
+            break;
+        case OPT_SWEEP_BAUD:
+            if (!strcmp(optarg, "all"))
+                nr_sweep_bauds = 0;
+            else
+                nr_sweep_bauds = parse_list(optarg, sweep_bauds, MAX_SWEEP);
+            break;
+        case OPT_SWEEP_COUNT:
+            nr_sweep_counts = parse_list(optarg, sweep_counts, MAX_SWEEP);
+            break;
+        case OPT_SWEEP_SAMPLES:
+            sweep_samples = atoi(optarg);
+            if (sweep_samples < 1)
+                fatal("a sweep needs at least one sample per combination");
+            break;
+        case OPT_SWEEP_TIME:
+            sweep_time = parse_time(optarg);
+            if (sweep_time <= 0)
+                fatal("the sweep time must be greater than zero");
+            break;
+        case OPT_RATE:
+            rate = atof(optarg);
+            if (rate <= 0)
+                fatal("the rate must be greater than zero");
+            break;
+        case OPT_PACE:
+            pace = pace_parse(optarg);
+            if (pace < 0)
+                fatal("unknown pacing '%s'", optarg);
+            break;
+        case OPT_SEED:
+            seed = strtoull(optarg, NULL, 0);
+            seed_given = 1;
+            break;
+        case OPT_SPIN:
+            spin_us = atof(optarg);
+            if (spin_us < 0)
+                fatal("the spin time must not be negative");
+            break;
+        case OPT_EMULATE:
+            emulate = 1;
+            if (optarg)
+                parse_emulate(&model, optarg);
+            break;
+        case OPT_BREAKTRACE:
+            breaktrace = 1;
+            parse_breaktrace(&bt_cfg, bt_file, sizeof bt_file, optarg);
+            break;
+        case OPT_NOISE:
+            noise = 1;
+            break;
+        case OPT_HARDEN:
+            harden = 1;
+            if (optarg) {
+                harden_cpu = atoi(optarg);
+                if (harden_cpu < 0 || harden_cpu >= online_cpus())
+                    fatal("no cpu %s to pin the tester to", optarg);
+            }
+            break;
+        case OPT_ECHO:
+            echo = 1;
+            if (optarg && strcmp(optarg, "stamp") == 0)
+                echo_stamp = 1;
+            else if (optarg)
+                fatal("unknown echo mode '%s'", optarg);
+            break;
+        case OPT_SUBTRACT:
+            calib.subtract = optarg ? calib_parse(optarg) : CALIB_TOOL;
+            if (calib.subtract < 0)
+                fatal("unknown noise floor '%s'", optarg);
+            break;
+        case OPT_BULK:
+            bulk = 1;
+            break;
+        case OPT_PHASES:
+            phases = 1;
+            break;
+        case OPT_CLOCK:
+            if (strcmp(optarg, "tsc") == 0)
+                use_tsc = 1;
+            else if (strcmp(optarg, "system") == 0)
+                use_tsc = 0;
+            else
+                fatal("unknown clock '%s'", optarg);
+            break;
+        case OPT_INTERVAL:
+            interval = parse_time(optarg);
+            if (interval <= 0)
+                fatal("the interval must be greater than zero");
+            break;
         default:
             usage(argv[0]);
             return EXIT_FAILURE;
         }
     }
 
+    const char *clock_name = hr_timer_init(use_tsc);
+
+    if (analyze) {
+        if (!argv[optind]) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return run_analyze(argv + optind, argc - optind);
+    }
+
+    if (compare) {
+        if (argc - optind != 2) {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        return run_compare(argv[optind], argv[optind + 1], tail, threshold);
+    }
+
     if (argc == 1 || argv[optind]) {
         usage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    if (soak && !samples_given)
+        nr_samples = 0;
+
+    if (interval < 0)
+        interval = soak ? 1 : 0;
+
+    if (rate > 0) {
+#if defined (HAVE_PTHREAD_H)
+        threaded = 1;
+#else
+        fatal("--rate requires pthreads");
+#endif
+        if (wait)
+            fatal("--rate and --wait do not go together");
+        if (!window_given)
+            window = MAX_WINDOW;
+    }
+
+    if (bulk) {
+#if !defined (HAVE_PTHREAD_H)
+        fatal("--bulk requires pthreads");
+#endif
+        if (nr_ports > 1 || sweep)
+            fatal("--bulk measures one port");
+        if (!count_given)
+            nr_count = 4096;
+        if (duration <= 0)
+            duration = 10;
+    }
+
+    if (noise && threaded)
+        fatal("--noise counts per thread, it needs to send and receive in one (no --threads or --rate)");
+
+    if (echo) {
+        if (nr_ports > 1 || bulk || sweep || emulate)
+            fatal("--echo answers on one port");
+        if (echo_stamp && nr_count < PACKET_MIN_LEN)
+            fatal("--echo=stamp needs -c of the initiator's --framed packets, at least %d",
+                  PACKET_MIN_LEN);
+    }
+
+    if (sweep) {
+        if (breaktrace)
+            fatal("--sweep does not do --breaktrace");
+        if (nr_ports > 1)
+            fatal("--sweep measures one port at a time");
+        if (strlen(log))
+            fatal("--sweep does not write a sample log");
+        interval = 0;
+        if (nr_sweep_bauds == 0) {
+            int i;
+            for (i = 0; i < MAX_SWEEP && serial_baud_rate(i); ++i)
+                sweep_bauds[i] = serial_baud_rate(i);
+            nr_sweep_bauds = i;
+        }
+    }
+
+    if (loss_timeout > 0 && !framed)
+        fatal("--loss-timeout counts lost --framed packets, it needs --framed");
+
+    if (framed && nr_count < PACKET_MIN_LEN) {
+        printf("> Warning: Framed packets are at least %d bytes! ", PACKET_MIN_LEN);
+        printf("Setting nr of bytes per sample to %d.\n", PACKET_MIN_LEN);
+        nr_count = PACKET_MIN_LEN;
+    }
+
     printf("> ");
     print_version();
 
@@ -374,8 +3046,13 @@ int main(int argc, char *argv[])
     print_uname();
 #endif
 
-    if (random_wait)
-        srand(getRandomNumber());
+    printf("> time stamps from %s, %.0f ns each\n", clock_name, hr_timer_cost_ns());
+
+    if (pace < 0)
+        pace = random_wait ? PACE_UNIFORM : PACE_FIXED;
+
+    if (!seed_given)
+        seed = pace_seed();
 
 #if defined (HAVE_SCHED_H)
     if (do_realtime) {
@@ -385,249 +3062,330 @@ int main(int argc, char *argv[])
     }
 #endif
 
-#if defined (HAVE_TERMIOS_H)
-    s.fd = serial_open(s.port, s.baud, &s.opts);
-#else
-    s.fd = serial_open(s.port, s.baud);
-#endif
+    /* before the emulator, the calibration and the threads start, which
+       all inherit it */
+    int shared = harden_cpu >= 0 ? harden_avoid(harden_cpu) : 0;
+
+    if (shared < 0)
+        fatal("unable to keep the tester off cpu %d", harden_cpu);
 
-    if (!s.fd) {
-        fatal("Unable to open %s", s.port);
+    if (emulate) {
+        if (nr_ports > 0)
+            fatal("--emulate provides the port itself");
+
+        model.baud = baud;
+        model.frame_bits = 10;      /* serial_open() sets 8N1 */
+        model.seed = seed;
+
+        if (emulate_start(&emu, &model) < 0)
+            fatal("unable to start the link emulator");
+        atexit(stop_emulator);
+
+        add_ports(ports, &nr_ports, emu.name);
+
+        printf("> emulating a link on %s: %d baud, delay %.3f ms, %s jitter %.3f ms, "
+               "batches of %.3f ms, loss %g%%\n", emu.name, baud, model.delay_ns / 1e6,
+               pace_name(model.jitter_dist), model.jitter_ns / 1e6, model.batch_ns / 1e6,
+               model.loss * 100);
     }
 
-#if defined (HAVE_LINUX_SERIAL_H)
-#if defined (ASYNC_LOW_LATENCY)
-    if (async_low_latency) {
-        if (serial_set_low_latency(s.fd) < 0) {
-            fatal("Unable to set ASYNC_LOW_LATENCY on %s", s.port);
-        } else {
-            printf("> set flag ASYNC_LOW_LATENCY to %d on %s\n", async_low_latency, s.port);
-        }
+    if (harden_cpu >= 0) {
+        if (shared)
+            printf("> Warning: sampling on cpu %d, the only one, shared with everything "
+                   "else of the tester\n", harden_cpu);
+        else
+            printf("> sampling on cpu %d, everything else of the tester on the others\n",
+                   harden_cpu);
+        print_cpu_conditions(harden_cpu, ports, nr_ports);
     }
+#if defined (HAVE_PTHREAD_H)
+    if (threaded && tx_cpu >= 0)
+        print_cpu_conditions(tx_cpu, ports, nr_ports);
+    if (threaded && rx_cpu >= 0 && rx_cpu != tx_cpu)
+        print_cpu_conditions(rx_cpu, ports, nr_ports);
 #endif
+    if (harden_cpu < 0 && !(threaded && (tx_cpu >= 0 || rx_cpu >= 0)))
+        printf("> the tester may migrate between cpus (see --harden=cpu)\n");
 
-    if (xmit_fifo_size > 0) {
-        if (serial_set_xmit_fifo_size(s.fd, xmit_fifo_size) < 0) {
-            fatal("Unable to set xmit_fifo_size %d on %s", xmit_fifo_size, s.port);
-        } else {
-            printf("> set xmit_fifo_size to %d on %s\n", serial_get_xmit_fifo_size(s.fd), s.port);
-        }
+    if (!bulk && !echo) {
+        calib_run(&calib, wait_strategy, baud, nr_count, CALIB_ROUNDS);
+        print_calib(&calib);
     }
+
+    if (nr_ports == 0)
+        nr_ports = 1;   /* serial_open() complains about the empty name */
+
+#if !defined (HAVE_PTHREAD_H)
+    if (nr_ports > 1)
+        fatal("measuring several ports requires pthreads");
 #endif
 
-    timerStruct begin, end;
+    int n;
 
-    printf("\n> sampling %d latency values - please wait..\n", nr_samples);
-    printf("   event     curr      min      max      avg [ms]\n");
+    for (n = 0; n < nr_ports; ++n) {
+        serial_t *s = &ports[n];
 
-    signal(SIGINT,  sighandler);
-    signal(SIGTERM, sighandler);
+        s->baud = baud;
 
-    double *delays = calloc(nr_samples + 1, sizeof *delays);
-    check_mem(delays);
+        printf("> opening %s at %d baud\n", s->port, s->baud);
 
-    int cnt_a;
-    double min_a, max_a;
-    double avg_a;
-    double var_m, var_s;
+#if defined (HAVE_TERMIOS_H)
+        s->fd = serial_open(s->port, s->baud, &s->opts);
+#else
+        s->fd = serial_open(s->port, s->baud);
+#endif
 
-    unsigned int *history = calloc(HISTLEN, sizeof(unsigned int));
-    unsigned int histsize = 0;
-    double bin_width = 0;
-    double bin_min = DBL_MIN;
-    unsigned int *histogram = NULL;
+        if (!s->fd) {
+            fatal("Unable to open %s", s->port);
+        }
 
-    cnt_a = 0;
-    min_a = DBL_MAX;
-    max_a = 0;
-    avg_a = 0;
-    var_m = var_s = 0;
+        s->frame_bits = serial_frame_bits(s->fd);
 
-    uint8_t *buf_rx = calloc(nr_count + 1, sizeof (uint8_t));
-    uint8_t *buf_tx = calloc(nr_count + 1, sizeof (uint8_t));
+        if (serial_wait_init(s->fd, &s->wait, wait_strategy, nr_count) < 0) {
+            fatal("Unable to set up waiting with %s on %s", serial_wait_name(wait_strategy), s->port);
+        }
 
-    unsigned int i;
+#if defined (HAVE_LINUX_SERIAL_H)
+#if defined (ASYNC_LOW_LATENCY)
+        if (async_low_latency) {
+            if (serial_set_low_latency(s->fd) < 0) {
+                fatal("Unable to set ASYNC_LOW_LATENCY on %s", s->port);
+            } else {
+                printf("> set flag ASYNC_LOW_LATENCY to %d on %s\n", async_low_latency, s->port);
+            }
+        }
+#endif
 
-    for (i = 0; i < nr_count; ++i) {
-        buf_tx[i] = i % 255;
+        if (xmit_fifo_size > 0) {
+            if (serial_set_xmit_fifo_size(s->fd, xmit_fifo_size) < 0) {
+                fatal("Unable to set xmit_fifo_size %d on %s", xmit_fifo_size, s->port);
+            } else {
+                printf("> set xmit_fifo_size to %d on %s\n", serial_get_xmit_fifo_size(s->fd), s->port);
+            }
+        }
+#endif
     }
 
-    time_t last = time(NULL);
+    test_t *tests = calloc(nr_ports, sizeof *tests);
+    check_mem(tests);
+
+    for (n = 0; n < nr_ports; ++n) {
+        test_t *t = &tests[n];
+
+        t->s = &ports[n];
+        t->nr_samples = nr_samples;
+        t->nr_count = nr_count;
+        t->window = window;
+        t->framed = framed;
+        t->loss_timeout = loss_timeout;
+        t->wait = wait;
+        pace_init(&t->pace, pace, rate > 0 ? 1e9 / rate : wait * 1e6, spin_us * 1e3, seed + n);
+        t->duration = duration;
+        t->interval = interval;
+        t->show_port = nr_ports > 1;
+        t->phases = phases;
+        t->rate = rate;
+        t->calib = bulk || echo ? NULL : &calib;
+        t->floor_ns = calib_floor(&calib);
+        t->cpu = harden_cpu;
+#if defined (HAVE_PTHREAD_H)
+        t->threaded = threaded;
+        t->tx_cpu = tx_cpu;
+        t->rx_cpu = rx_cpu;
+#endif
+        if (noise) {
+            t->noise = malloc(sizeof *t->noise);
+            check_mem(t->noise);
+            int nr = noise_init(t->noise, t->s->port, 1);
+            printf("> attributing samples to host noise: context switches, page faults "
+                   "and %d interrupt lines of %s\n", nr, t->s->port);
+        }
 
-    int err = 0;
+        char name[PATH_MAX + 16];
 
-    for (c = 0; c < nr_samples; ++c) {
-        if (wait) {
-            if (random_wait)
-                wait_ms(wait + rand() * wait / RAND_MAX);
-            else
-                wait_ms(wait);
-            if (signal_received)
-                break;
+        if (strlen(output) && !sweep) {
+            port_file_name(name, sizeof name, output, n, nr_ports);
+            t->out = fopen(name, "w");
+            if (!t->out) {
+                fatal("unable to open output file '%s'", name);
+            }
         }
 
-        int n = 0;
+        test_init(t);
 
-        GetHighResolutionTime(&begin);
-
-        n = serial_write(s.fd, buf_tx, nr_count);
+        if (strlen(log)) {
+            port_file_name(name, sizeof name, log, n, nr_ports);
+            open_log(t, name);
+        }
 
-        if (n != nr_count) {
-            fprintf(stderr, "serial_write() n = %d nr_count = %d\n", n, nr_count);
-            err = 1;
-            signal_received = 1;
+        if (breaktrace) {
+            port_file_name(name, sizeof name, bt_file, n, nr_ports);
+            breaktrace_init(t, &bt_cfg, name);
         }
+    }
 
-        if (signal_received)
-            break;
+    if (breaktrace) {
+        trace_open();
+        printf("> breaktrace over %.3f ms: %d samples before and %d after to %s%s, %s\n",
+               bt_cfg.threshold_ns / 1e6, bt_cfg.before, bt_cfg.after, bt_file,
+               nr_ports > 1 ? ".<n>" : "", bt_cfg.keep ? "then keep going" : "then stop");
+        if (trace_marker_fd < 0)
+            printf("> no tracefs, spikes are not marked in the kernel trace\n");
+    }
 
-        int rd = 0;
+    /* after all allocations, so they are locked in as well */
+    if (!harden)
+        printf("> memory not locked, page faults may hit samples (see --harden)\n");
+    else if (harden_memory(HARDEN_STACK) < 0)
+        printf("> Warning: unable to lock memory, page faults may hit samples\n");
+    else
+        printf("> locked all memory and prefaulted %d KB of stack\n", HARDEN_STACK / 1024);
 
-        while(!rd) {
-            n = serial_read(s.fd, buf_rx, nr_count); // blocking read using select
+    signal(SIGINT,  sighandler);
+    signal(SIGTERM, sighandler);
 
-            if (n == nr_count) {
-                rd = 1;
-            } else {
-                rd = 1;
-                signal_received = 1;
-                err = 1;
-                fprintf(stderr, "serial_read() n = %d nr_count = %d\n", n, nr_count);
-            }
-        }
+    /* echo and bulk start no reporter or peer, they run on the cpu as a whole */
+    if ((echo || bulk) && harden_cpu >= 0 && harden_pin(harden_cpu) < 0)
+        fatal("unable to pin the tester to cpu %d", harden_cpu);
 
-        if (signal_received)
-            break;
+    if (echo) {
+        int ret = run_echo(&ports[0], nr_count, echo_stamp);
+
+        close_ports(tests, ports, nr_ports);
 
-        GetHighResolutionTime(&end);
+        return ret;
+    }
 
-        double delay = ConvertTimeDifferenceToSec(&end, &begin) * 1000.0;
+#if defined (HAVE_PTHREAD_H)
+    if (bulk) {
+        int ret = run_bulk(&ports[0], nr_count, duration);
 
-        delays[cnt_a] = delay;
+        close_ports(tests, ports, nr_ports);
 
-        time_t now = time(NULL);
+        return ret;
+    }
+#endif
 
-        if (printinterval > 0 && now >= last + printinterval) {
-            last = now;
-            if (cnt_a > 0)
-                printf("\n");
-        }
+    if (sweep) {
+        FILE *f = strlen(output) ? fopen(output, "w") : stdout;
 
-        avg_a += delay;
+        if (!f)
+            fatal("unable to open output file '%s'", output);
 
-        if (delay < min_a) min_a = delay;
-        if (delay > max_a) max_a = delay;
+        int ret = run_sweep(&tests[0], sweep_bauds, nr_sweep_bauds,
+                            sweep_counts, nr_sweep_counts, sweep_samples, sweep_time,
+                            sweep_json, f);
 
-        printf(" %7d %8.2f %8.2f %8.2f %8.2f\r", cnt_a, delay, min_a, max_a, avg_a / (double)cnt_a);
+        if (f != stdout)
+            fclose(f);
 
-        /* histogram */
-        if (cnt_a < HISTLEN) {
-            history[cnt_a] = delay;
-        } else if (cnt_a == HISTLEN) {
-            int j;
-            double stddev = 0;
-            const double avg = avg_a / (double)HISTLEN;
-            for (j = 0; j < HISTLEN; ++j) {
-                stddev += SQUARE((double)history[j] - avg);
-            }
-            stddev = sqrt(stddev/(double)HISTLEN);
-            // Scott's normal reference rule
-            bin_width = 3.5 * stddev * pow(HISTLEN, -1.0/3.0);
-            int k = ceil((double)(max_a - min_a) / bin_width);
-
-            bin_min = min_a;
-            if (bin_min > bin_width) { k++; bin_min -= bin_width; }
-            if (bin_min > bin_width) { k++; bin_min -= bin_width; }
-            histsize = k+2;
-
-/*
-  if (printinterval > 0) {
-  printf("\n -- initializing histogram with %d bins (min:%.2f w:%.2f [samples]) --\n", histsize, bin_min, bin_width);
-  }
-*/
-            histogram = calloc(histsize + 1,sizeof(unsigned int));
-            for (j = 0; j < HISTLEN; ++j) {
-                int bin = RAIL(floor(((double)history[j] - bin_min) / bin_width), 0, histsize);
-                histogram[bin]++;
-            }
-        } else {
-            int bin = RAIL(floor(((double)delay - bin_min) / bin_width), 0, histsize);
-            histogram[bin]++;
-        }
+        close_ports(tests, ports, nr_ports);
 
-        cnt_a++;
+        return ret;
     }
 
-    if (strlen(output)) {
-        FILE *fp = fopen(output, "w");
+    printf("> %d bytes of %d bits take %.3f ms on the wire at %d baud\n", nr_count,
+           ports[0].frame_bits, wire_ns(&tests[0]) / 1e6, baud);
 
-        if (!fp) {
-            fatal("unable to open output file '%s'", output);
-        }
+    char what[128];
 
-        for (i = 0; i < cnt_a; ++i) {
-            fprintf(fp, "%8.2f\n", delays[i]);
-        }
+    if (nr_samples > 0)
+        snprintf(what, sizeof what, "%d latency values", nr_samples);
+    else if (duration > 0)
+        snprintf(what, sizeof what, "latency values for %g s", duration);
+    else
+        snprintf(what, sizeof what, "latency values until interrupted");
 
-        fclose(fp);
+    if (nr_ports > 1) {
+        printf("\n> sampling %s on each of %d ports - please wait..\n", what, nr_ports);
+    } else if (window > 1) {
+        printf("\n> sampling %s with %d packets in flight - please wait..\n", what, window);
+    } else {
+        printf("\n> sampling %s - please wait..\n", what);
+    }
+    if (wait_strategy != SERIAL_WAIT_SELECT) {
+        printf("> waiting for replies with %s\n", serial_wait_name(wait_strategy));
     }
+#if defined (HAVE_PTHREAD_H)
+    if (threaded) {
+        printf("> using separate TX (cpu %d) and RX (cpu %d) threads\n", tx_cpu, rx_cpu);
+    }
+#endif
+    if (interval > 0)
+        print_interval_header(nr_ports > 1);
+    else if (nr_ports == 1)
+        printf("   event     curr      min      max      avg [ms]\n");
 
-    if (!err) {
-        printf("\n> done.\n\n");
-    } else {
-        printf("\n> done (with errors).\n\n");
+    timerStruct wall_begin, wall_end;
+    double cpu_begin = cpu_time();
+
+    reporter_start(tests, nr_ports, nr_ports == 1 && interval <= 0);
+
+    GetHighResolutionTime(&wall_begin);
+
+#if defined (HAVE_PTHREAD_H)
+    if (nr_ports > 1)
+        run_ports(tests, nr_ports);
+    else
+#endif
+        run_test(&tests[0]);
+
+    GetHighResolutionTime(&wall_end);
+
+    reporter_stop();
+
+    double cpu = cpu_time() - cpu_begin;
+    double wall = ConvertTimeDifferenceToSec(&wall_end, &wall_begin);
+
+    for (n = 0; n < nr_ports; ++n) {
+        if (tests[n].out)
+            fclose(tests[n].out);
+        if (tests[n].log && slog_close(tests[n].log) < 0)
+            fprintf(stderr, "> unable to close sample log of %s\n", ports[n].port);
     }
 
-    if (histsize > 0) {
-        printf("> latency distribution:\n\n");
-        int i,j;
-        int binlevel = 0;
-        for (i = 0; i < histsize; ++i) {
-            if (histogram[i] > binlevel) binlevel = histogram[i];
-        }
-
-        if (binlevel > 0) {
-            int dig = digits(max_a); char fmt[256];
-            snprintf(fmt, sizeof(fmt), " %%%d.2f .. %%%d.2f [ms]: %%%dd ", dig + 4, dig + 4, digits(cnt_a));
-            for (i = 0; i <= histsize; ++i) {
-                double hmin, hmax;
-                if (i == 0) {
-                    hmin = 0.0;
-                    hmax = bin_min;
-                } else if (i == histsize) {
-                    hmin = bin_min + (double)(i-1) * bin_width;
-                    hmax = INFINITY;
-                } else {
-                    hmin = bin_min + (double)(i-1) * bin_width;
-                    hmax = bin_min + (double)(i) * bin_width;
-                }
-                printf(fmt, hmin, hmax, histogram[i]);
-                int bar_width = (histogram[i] * TERMWIDTH ) / binlevel;
-                if (bar_width == 0 && histogram[i] > 0) bar_width = 1;
-                for (j = 0; j < bar_width; ++j) printf("#");
-                printf("\n");
-            }
+    if (nr_ports == 1) {
+        print_report(&tests[0], cpu);
+    } else {
+        /* one report over the samples of all ports */
+        test_t all = tests[0];
+
+        stats_init(&all.stats, window, phases, rate > 0, noise);
+        memset(&all.track.ps, 0, sizeof all.track.ps);
+        all.err = 0;
+        all.run_begin = wall_begin;
+        all.run_end = wall_end;
+        histogram_reset(&all.pace.err);
+
+        for (n = 0; n < nr_ports; ++n) {
+            pkt_stats_t *a = &all.track.ps, *p = &tests[n].track.ps;
+            stats_merge(&all.stats, &tests[n].stats, window);
+            histogram_merge(&all.pace.err, &tests[n].pace.err);
+            a->sent += p->sent;
+            a->received += p->received;
+            a->lost += p->lost;
+            a->late += p->late;
+            a->duplicated += p->duplicated;
+            a->reordered += p->reordered;
+            a->corrupt += p->corrupt;
+            all.err |= tests[n].err;
         }
 
-        printf("\n");
-        printf(" best    latency was %.2f ms\n", min_a);
-        printf(" worst   latency was %.2f ms\n", max_a);
-        printf(" average latency was %.2f ms\n", avg_a / (double)cnt_a);
-        printf("\n");
+        print_ports(tests, nr_ports, cpu, wall);
+        print_report(&all, cpu);
+        stats_free(&all.stats);
     }
 
-    free(histogram);
-    free(history);
+    for (n = 0; n < nr_ports; ++n) {
+        breaktrace_t *bt = tests[n].bt;
 
-    free(delays);
-    free(buf_rx);
-    free(buf_tx);
+        if (bt && bt->spikes > 0)
+            printf("> breaktrace of %s: %lu spikes over %.3f ms, %lu written, %lu missed "
+                   "while writing\n\n", ports[n].port, bt->spikes, bt->threshold_ns / 1e6,
+                   bt->written, bt->skipped);
+    }
 
-#if defined(HAVE_TERMIOS_H)
-    serial_close(s.fd, &s.opts);
-#else
-    serial_close(s.fd);
-#endif
+    close_ports(tests, ports, nr_ports);
 
     return EXIT_SUCCESS;
 }
@@ -22,6 +22,13 @@
 #if defined (HAVE_ASM_IOCTLS_H)
 #include <asm/ioctls.h>
 #endif
+#if defined (HAVE_POLL_H)
+#include <poll.h>
+#endif
+#if defined (HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#endif
+#include <time.h>
 
 // #define DBG(M, ...)
 #define DBG(M, ...) fprintf(stderr, "%s:%d: " M "\n", __FILE__, __LINE__, ##__VA_ARGS__)
@@ -131,6 +138,350 @@ ssize_t serial_read(PORTTYPE fd, uint8_t *buf, size_t len)
 	return count;
 }
 
+/* discards all data received but not read yet */
+int serial_flush(PORTTYPE fd)
+{
+#if defined (_WIN32)
+	return PurgeComm(fd, PURGE_RXCLEAR) ? 0 : -1;
+#elif defined (HAVE_TERMIOS_H)
+	if (tcflush(fd, TCIFLUSH) < 0) {
+		log_err("tcflush() failed");
+		return -1;
+	}
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+#if defined (HAVE_TERMIOS_H)
+#define SPEED(x) B##x
+typedef speed_t baud_speed_t;
+#else
+#define SPEED(x) x
+typedef DWORD baud_speed_t;
+#endif
+
+/* the baud rates serial_open() and serial_set_baud() support */
+static const struct {
+	int baud;
+	baud_speed_t speed;
+} baud_rates[] = {
+#define B(x) { x, SPEED(x) },
+	B(50)		B(75)		B(110)		B(134)		B(150)
+	B(200)		B(300)		B(600)		B(1200)		B(1800)
+	B(2400)		B(4800)		B(9600)		B(19200)	B(38400)
+	B(57600)	B(115200)	B(230400)	B(460800)
+#if defined B500000 || defined (_WIN32)
+	B(500000)	B(576000)	B(921600)	B(1000000)	B(1152000)
+	B(1500000)	B(2000000)	B(2500000)	B(3000000)	B(3500000)	B(4000000)
+#endif
+#undef B
+};
+
+static int baud_speed(int baud, baud_speed_t *speed)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof baud_rates / sizeof baud_rates[0]; ++i) {
+		if (baud_rates[i].baud == baud) {
+			*speed = baud_rates[i].speed;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/* returns the i-th supported baud rate in ascending order, 0 past the last */
+int serial_baud_rate(int i)
+{
+	if (i < 0 || i >= (int)(sizeof baud_rates / sizeof baud_rates[0]))
+		return 0;
+
+	return baud_rates[i].baud;
+}
+
+/* changes the baud rate of an open port, once all output has been sent */
+int serial_set_baud(PORTTYPE fd, int baud)
+{
+	baud_speed_t speed;
+
+	if (baud_speed(baud, &speed) < 0) {
+		log_err("unknown baud rate %d", baud);
+		return -1;
+	}
+
+#if defined (_WIN32)
+	DCB dcb;
+
+	if (!GetCommState(fd, &dcb)) {
+		log_err("GetCommState() failed");
+		return -1;
+	}
+
+	dcb.BaudRate = speed;
+
+	if (!SetCommState(fd, &dcb)) {
+		log_err("SetCommState() failed");
+		return -1;
+	}
+#elif defined (HAVE_TERMIOS_H)
+	struct termios toptions;
+
+	if (tcgetattr(fd, &toptions) < 0) {
+		log_err("tcgetattr() failed");
+		return -1;
+	}
+
+	cfsetispeed(&toptions, speed);
+	cfsetospeed(&toptions, speed);
+
+	if (tcsetattr(fd, TCSADRAIN, &toptions) < 0) {
+		log_err("tcsetattr() failed");
+		return -1;
+	}
+
+	if (tcgetattr(fd, &toptions) < 0 || cfgetospeed(&toptions) != speed) {
+		log_err("baud rate %d not accepted", baud);
+		return -1;
+	}
+#endif
+
+	return serial_flush(fd);
+}
+
+static const char *wait_names[SERIAL_WAIT_COUNT] = {
+	"select", "poll", "epoll", "vmin", "spin"
+};
+
+/* returns the SERIAL_WAIT_* strategy of given name, or -1 if it is unknown
+   or not available on this system */
+int serial_wait_parse(const char *name)
+{
+	int i;
+
+	for (i = 0; i < SERIAL_WAIT_COUNT; ++i) {
+		if (strcmp(name, wait_names[i]) != 0)
+			continue;
+#if defined (_WIN32)
+		if (i != SERIAL_WAIT_SELECT) return -1;
+#endif
+#if !defined (HAVE_POLL_H)
+		if (i == SERIAL_WAIT_POLL) return -1;
+#endif
+#if !defined (HAVE_SYS_EPOLL_H)
+		if (i == SERIAL_WAIT_EPOLL) return -1;
+#endif
+		return i;
+	}
+
+	return -1;
+}
+
+const char *serial_wait_name(int strategy)
+{
+	return wait_names[strategy];
+}
+
+/* prepares fd for reading packets of len bytes with serial_read_wait().
+   All strategies but vmin make read() return at once with what has been
+   received so far (VMIN = VTIME = 0) and wait for more on their own, the
+   file descriptor itself stays blocking so writes are not affected. */
+int serial_wait_init(PORTTYPE fd, serial_wait_t *w, int strategy, size_t len)
+{
+	w->strategy = strategy;
+	w->epfd = -1;
+	w->timeout_ms = SERIAL_TIMEOUT_MS;
+
+#if defined (HAVE_TERMIOS_H)
+	struct termios toptions;
+
+	if (tcgetattr(fd, &toptions) < 0) {
+		log_err("tcgetattr() failed");
+		return -1;
+	}
+
+	if (strategy == SERIAL_WAIT_VMIN) {
+		/* VTIME is the inter-byte timeout here, the first byte is
+		   waited for forever */
+		toptions.c_cc[VMIN]  = len < 255 ? len : 255;
+		toptions.c_cc[VTIME] = 10;
+	} else {
+		toptions.c_cc[VMIN]  = 0;
+		toptions.c_cc[VTIME] = 0;
+	}
+
+	if (tcsetattr(fd, TCSANOW, &toptions) < 0) {
+		log_err("tcsetattr() failed");
+		return -1;
+	}
+#endif
+
+#if defined (HAVE_SYS_EPOLL_H)
+	if (strategy == SERIAL_WAIT_EPOLL) {
+		struct epoll_event ev;
+
+		w->epfd = epoll_create1(0);
+		if (w->epfd < 0) {
+			log_err("epoll_create1() failed");
+			return -1;
+		}
+
+		memset(&ev, 0, sizeof ev);
+		ev.events = EPOLLIN;
+		ev.data.fd = fd;
+
+		if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			log_err("epoll_ctl() failed");
+			close(w->epfd);
+			w->epfd = -1;
+			return -1;
+		}
+	}
+#endif
+
+	return 0;
+}
+
+void serial_wait_free(serial_wait_t *w)
+{
+	if (w->epfd >= 0)
+		close(w->epfd);
+	w->epfd = -1;
+}
+
+#if !defined (_WIN32)
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* one select(), poll() or epoll_wait() of up to timeout_ms */
+static int wait_once(PORTTYPE fd, serial_wait_t *w, int timeout_ms)
+{
+	int r = 0;
+
+	switch (w->strategy) {
+#if defined (HAVE_POLL_H)
+	case SERIAL_WAIT_POLL: {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		r = poll(&pfd, 1, timeout_ms);
+		break;
+	}
+#endif
+#if defined (HAVE_SYS_EPOLL_H)
+	case SERIAL_WAIT_EPOLL: {
+		struct epoll_event ev;
+		r = epoll_wait(w->epfd, &ev, 1, timeout_ms);
+		break;
+	}
+#endif
+	default: {
+		fd_set fds;
+		struct timeval t;
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		t.tv_sec = timeout_ms / 1000;
+		t.tv_usec = timeout_ms % 1000 * 1000;
+		r = select(fd+1, &fds, NULL, NULL, &t);
+		break;
+	}
+	}
+
+	return r;
+}
+
+/* waits up to timeout_ms for fd to become readable, returns 1 if it is, 0
+   on timeout and -1 on errors. A signal does not end the wait, it goes on
+   for the time that is left, so it does not pass for a lost reply. */
+static int wait_readable(PORTTYPE fd, serial_wait_t *w, int timeout_ms)
+{
+	double deadline = now_sec() + timeout_ms / 1e3;
+	int r;
+
+	while ((r = wait_once(fd, w, timeout_ms)) < 0 && errno == EINTR) {
+		double left = deadline - now_sec();
+
+		if (left <= 0)
+			return 0;
+		timeout_ms = (int)(left * 1e3) + 1;
+	}
+
+	return r < 0 ? -1 : r > 0;
+}
+#endif
+
+#if !defined (_WIN32)
+static ssize_t read_wait(PORTTYPE fd, serial_wait_t *w, uint8_t *buf, size_t len, int any)
+{
+	ssize_t count = 0, r;
+	double deadline = 0;
+
+	while (count < len) {
+		r = read(fd, buf + count, len - count);
+
+		if (r < 0 && errno != EAGAIN && errno != EINTR) return -1;
+		if (r > 0) {
+			count += r;
+			deadline = 0;
+			if (any) break;
+			continue;
+		}
+
+		if (w->strategy == SERIAL_WAIT_VMIN) {
+			/* the inter-byte timeout expired or a signal came in */
+			break;
+		}
+
+		if (w->strategy == SERIAL_WAIT_SPIN) {
+			double now = now_sec();
+			if (deadline == 0)
+				deadline = now + w->timeout_ms / 1e3;
+			else if (now > deadline)
+				break;
+			continue;
+		}
+
+		r = wait_readable(fd, w, w->timeout_ms);
+		if (r < 0) return -1;
+		if (r == 0) break; // timeout
+	}
+
+	return count;
+}
+#endif
+
+/* reads len bytes like serial_read(), waiting for them the way w was set
+   up for by serial_wait_init(). Returns fewer bytes if none arrived for
+   w->timeout_ms, and -1 on errors. */
+ssize_t serial_read_wait(PORTTYPE fd, serial_wait_t *w, uint8_t *buf, size_t len)
+{
+#if defined (_WIN32)
+	return serial_read(fd, buf, len);
+#else
+	return read_wait(fd, w, buf, len, 0);
+#endif
+}
+
+/* like serial_read_wait(), but returns with the bytes of the first read()
+   that got any, so the caller can time their arrival */
+ssize_t serial_read_any(PORTTYPE fd, serial_wait_t *w, uint8_t *buf, size_t len)
+{
+#if defined (_WIN32)
+	return serial_read(fd, buf, len);
+#else
+	return read_wait(fd, w, buf, len, 1);
+#endif
+}
+
 #if defined (HAVE_TERMIOS_H)
 PORTTYPE serial_open(const char *port, int baud, struct termios *opts)
 #else
@@ -139,8 +490,6 @@ PORTTYPE serial_open(const char *port, int baud, struct termios *opts)
 {
 	PORTTYPE fd;
 
-	DBG("opening port %s @ %d bps", port, baud);
-
 	if (!strlen(port)) {
 		log_err("invalid port name %s", port);
 		return 0;
@@ -214,24 +563,11 @@ PORTTYPE serial_open(const char *port, int baud, struct termios *opts)
 		return 0;
 	}
 
-	speed_t brate = baud; // let you override switch below if needed
-
-	switch(baud) {
-#define B(x) case x: brate=B##x; break;
-		B(50);		B(75);		B(110);		B(134);		B(150);
-		B(200);		B(300);		B(600);		B(1200);	B(1800);
-		B(2400);	B(4800);	B(9600);	B(19200);	B(38400);
-		B(57600);	B(115200);	B(230400);	B(460800);
-#if defined B500000
-		B(500000); B(576000); B(921600); B(1000000); B(1152000);
-		B(1500000); B(2000000); B(2500000);B(3000000); B(3500000); B(4000000);
-#endif
+	speed_t brate;
 
-#undef B
-	default:
+	if (baud_speed(baud, &brate) < 0) {
 		log_err("unknown baud rate %d", baud);
 		return 0;
-		break;
 	}
 
 	cfsetispeed(&toptions, brate);
@@ -281,6 +617,32 @@ PORTTYPE serial_open(const char *port, int baud, struct termios *opts)
 	return fd;
 }
 
+/* bits per character on the wire: start bit, data bits, parity bit and
+   stop bits */
+int serial_frame_bits(PORTTYPE fd)
+{
+#if defined (HAVE_TERMIOS_H)
+	struct termios toptions;
+	int bits;
+
+	if (tcgetattr(fd, &toptions) < 0) {
+		log_err("tcgetattr() failed");
+		return 10;
+	}
+
+	switch (toptions.c_cflag & CSIZE) {
+	case CS5: bits = 5; break;
+	case CS6: bits = 6; break;
+	case CS7: bits = 7; break;
+	default:  bits = 8; break;
+	}
+
+	return 1 + bits + (toptions.c_cflag & PARENB ? 1 : 0) + (toptions.c_cflag & CSTOPB ? 2 : 1);
+#else
+	return 10;	/* serial_open() sets 8N1 */
+#endif
+}
+
 #if defined (HAVE_TERMIOS_H)
 int serial_close(PORTTYPE fd, struct termios *opts)
 #else
@@ -18,12 +18,34 @@ extern "C" {
 #include <unistd.h>
 #include <stdint.h>
 
+#include "slprefix.h"
+
 #if defined (HAVE_TERMIOS_H)
 #define PORTTYPE int
 #else
 #define PORTTYPE HANDLE
 #endif
 
+/* how serial_read_wait() waits for data to arrive */
+enum {
+	SERIAL_WAIT_SELECT,	/* select() until readable */
+	SERIAL_WAIT_POLL,	/* poll() until readable */
+	SERIAL_WAIT_EPOLL,	/* epoll_wait() on a per port epoll instance */
+	SERIAL_WAIT_VMIN,	/* blocking read() returning after VMIN bytes */
+	SERIAL_WAIT_SPIN,	/* read() in a busy loop */
+	SERIAL_WAIT_COUNT
+};
+
+/* how long serial_read_wait() waits for more bytes by default */
+#define SERIAL_TIMEOUT_MS 1000
+
+typedef struct {
+	int strategy;
+	int epfd;		/* SERIAL_WAIT_EPOLL only */
+	int timeout_ms;		/* give up after no byte came for this long,
+				   ignored by vmin */
+} serial_wait_t;
+
 #if defined (HAVE_TERMIOS_H)
 	PORTTYPE serial_open(const char *port, int baud, struct termios *opts);
 	int		 serial_close(PORTTYPE fd, struct termios *opts);
@@ -41,6 +63,17 @@ extern "C" {
 	ssize_t	 serial_writebyte(PORTTYPE fd, uint8_t byte);
 	ssize_t	 serial_write(PORTTYPE fd, const uint8_t *buf, size_t len);
 	ssize_t	 serial_read(PORTTYPE fd, uint8_t *buf, size_t len);
+	int		 serial_flush(PORTTYPE fd);
+	int		 serial_frame_bits(PORTTYPE fd);
+	int		 serial_baud_rate(int i);
+	int		 serial_set_baud(PORTTYPE fd, int baud);
+
+	int		 serial_wait_parse(const char *name);
+	const char *serial_wait_name(int strategy);
+	int		 serial_wait_init(PORTTYPE fd, serial_wait_t *w, int strategy, size_t len);
+	void	 serial_wait_free(serial_wait_t *w);
+	ssize_t	 serial_read_wait(PORTTYPE fd, serial_wait_t *w, uint8_t *buf, size_t len);
+	ssize_t	 serial_read_any(PORTTYPE fd, serial_wait_t *w, uint8_t *buf, size_t len);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -0,0 +1,220 @@
+#include "seriallatency.h"
+#include "serial.h"
+#include "packet.h"
+#include "probe.h"
+#include "histogram.h"
+#include "hr_timer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* the public header cannot include packet.h */
+typedef char sl_framed_min_check[SL_FRAMED_MIN == PACKET_MIN_LEN ? 1 : -1];
+
+struct sl_session {
+	PORTTYPE fd;
+#if defined (HAVE_TERMIOS_H)
+	struct termios opts;	/* of the port before it was opened */
+#endif
+	serial_wait_t wait;
+	sl_config_t cfg;
+	int frame_bits;
+	probe_t probe;
+	uint32_t seq;
+
+	histogram_t hist;
+	uint64_t timeouts;
+	unsigned long corrupt;
+};
+
+void sl_config_default(sl_config_t *c)
+{
+	memset(c, 0, sizeof *c);
+	c->baud = 9600;
+	c->count = 1;
+	c->framed = 0;
+	c->wait = "select";
+	c->use_tsc = 1;
+}
+
+static int configure(sl_session_t *s, const sl_config_t *c, int init_timer);
+
+/* opens port with the default configuration, returns NULL on errors */
+sl_session_t *sl_open(const char *port)
+{
+	sl_session_t *s = calloc(1, sizeof *s);
+	sl_config_t c;
+
+	if (!s)
+		return NULL;
+
+	s->wait.epfd = -1;
+
+#if defined (HAVE_TERMIOS_H)
+	s->fd = serial_open(port, 9600, &s->opts);
+#else
+	s->fd = serial_open(port, 9600);
+#endif
+	if (!s->fd) {
+		free(s);
+		return NULL;
+	}
+
+	sl_config_default(&c);
+
+	/* leave the clock to the caller's configuration */
+	if (configure(s, &c, 0) < 0) {
+		sl_close(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+static int configure(sl_session_t *s, const sl_config_t *c, int init_timer)
+{
+	int strategy = serial_wait_parse(c->wait ? c->wait : "select");
+	probe_t probe;
+
+	if (strategy < 0 || c->count <= 0 || (c->framed && c->count < PACKET_MIN_LEN)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* the clock is set up once per process, maybe by the caller */
+	if (init_timer && !hr_timer_initialized())
+		hr_timer_init(c->use_tsc);
+
+	if (serial_set_baud(s->fd, c->baud) < 0)
+		return -1;
+
+	if (probe_init(&probe, s->fd, &s->wait, c->count, c->framed) < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	serial_wait_free(&s->wait);
+	if (serial_wait_init(s->fd, &s->wait, strategy, c->count) < 0) {
+		probe_free(&probe);
+		return -1;
+	}
+
+	probe_free(&s->probe);
+	s->probe = probe;
+
+	s->cfg = *c;
+	s->cfg.wait = serial_wait_name(strategy);
+	s->frame_bits = serial_frame_bits(s->fd);
+
+	serial_flush(s->fd);
+	sl_stats(s, NULL, 1);
+
+	return 0;
+}
+
+/* applies c and restarts the statistics, returns -1 with errno set if
+   the port does not take it */
+int sl_configure(sl_session_t *s, const sl_config_t *c)
+{
+	return configure(s, c, 1);
+}
+
+/* sends one packet and waits for it to come back. Returns SL_OK with its
+   roundtrip time, less the turnaround an --echo=stamp responder put into
+   a framed packet, in *latency_ns, or one of the other SL_* results. */
+int sl_sample(sl_session_t *s, uint64_t *latency_ns)
+{
+	probe_t *p = &s->probe;
+	uint32_t seq = s->seq++, rx_seq;
+	timerStruct begin, end;
+	uint64_t ns, turnaround;
+	int r;
+
+	GetHighResolutionTime(&begin);
+
+	probe_stamp(p, seq, 0);
+
+	if (probe_send(p) != p->len)
+		return SL_ERROR;
+
+	r = probe_recv(p, seq, &rx_seq, &s->corrupt);
+
+	GetHighResolutionTime(&end);
+
+	if (r == PROBE_ERROR)
+		return SL_ERROR;
+
+	if (r == PROBE_TIMEOUT) {
+		s->timeouts++;
+		serial_flush(s->fd);
+		return SL_TIMEOUT;
+	}
+
+	/* a reply of an earlier sample that timed out counts as garbled too */
+	if (r == PROBE_CORRUPT || rx_seq != seq) {
+		s->corrupt++;
+		serial_flush(s->fd);
+		return SL_CORRUPT;
+	}
+
+	ns = ConvertTimeDifferenceToNs(&end, &begin);
+	turnaround = probe_turnaround(p);
+	ns = ns > turnaround ? ns - turnaround : 0;
+
+	histogram_add(&s->hist, ns);
+
+	if (latency_ns)
+		*latency_ns = ns;
+
+	return SL_OK;
+}
+
+/* fills st, if given, with the statistics so far and restarts them if
+   reset is set */
+void sl_stats(sl_session_t *s, sl_stats_t *st, int reset)
+{
+	const histogram_t *h = &s->hist;
+
+	if (st) {
+		memset(st, 0, sizeof *st);
+		st->samples = h->total;
+		st->timeouts = s->timeouts;
+		st->corrupt = s->corrupt;
+		if (h->total) {
+			st->min = h->min;
+			st->max = h->max;
+			st->mean = h->mean;
+			st->stddev = histogram_stddev(h);
+			st->p50 = histogram_percentile(h, 50);
+			st->p90 = histogram_percentile(h, 90);
+			st->p99 = histogram_percentile(h, 99);
+			st->p999 = histogram_percentile(h, 99.9);
+			st->p9999 = histogram_percentile(h, 99.99);
+		}
+		st->wire = (uint64_t)s->cfg.count * s->frame_bits * 1000000000ULL / s->cfg.baud;
+	}
+
+	if (reset) {
+		histogram_reset(&s->hist);
+		s->timeouts = 0;
+		s->corrupt = 0;
+	}
+}
+
+void sl_close(sl_session_t *s)
+{
+	if (!s)
+		return;
+
+	serial_wait_free(&s->wait);
+
+#if defined (HAVE_TERMIOS_H)
+	serial_close(s->fd, &s->opts);
+#else
+	serial_close(s->fd);
+#endif
+
+	probe_free(&s->probe);
+	free(s);
+}
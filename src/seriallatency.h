@@ -0,0 +1,81 @@
+#ifndef SERIALLATENCY_H
+#define SERIALLATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* libseriallatency measures the roundtrip time of packets over a serial
+ * port whose RX and TX are looped back, or which an --echo responder
+ * answers, for embedding latency probes into other programs:
+ *
+ *	sl_session_t *s = sl_open("/dev/ttyUSB0");
+ *	sl_config_t c;
+ *
+ *	sl_config_default(&c);
+ *	c.baud = 115200;
+ *	if (!s || sl_configure(s, &c) < 0) ...
+ *
+ *	for (;;) {
+ *		uint64_t ns;
+ *		if (sl_sample(s, &ns) == SL_OK) ...
+ *		...
+ *		sl_stats(s, &st, 1);	(every minute, say)
+ *	}
+ *
+ *	sl_close(s);
+ *
+ * sl_sample() needs a session configured by sl_configure() at least
+ * once, which sets up the clock. sl_open() and sl_configure() allocate
+ * all a session needs, sl_sample() and sl_stats() never allocate. A
+ * session is not thread safe, call sl_stats() from the thread that
+ * samples or serialise the calls.
+ */
+
+typedef struct sl_session sl_session_t;
+
+typedef struct {
+	int baud;		/* default 9600 */
+	int count;		/* bytes per sample, default 1 */
+	int framed;		/* send sequence numbered, checksummed packets of at
+				   least SL_FRAMED_MIN bytes, default 0 */
+	const char *wait;	/* how to wait for replies: select, poll, epoll,
+				   vmin or spin, default select */
+	int use_tsc;		/* time stamp with the TSC if it is stable, default 1;
+				   taken from the first sl_configure() call */
+} sl_config_t;
+
+/* sl_sample() results */
+enum {
+	SL_OK = 0,
+	SL_TIMEOUT = -1,	/* no reply within 1 s */
+	SL_CORRUPT = -2,	/* a reply came back garbled or out of order */
+	SL_ERROR = -3		/* the port failed, see errno */
+};
+
+#define SL_FRAMED_MIN 19
+
+/* statistics of the samples since the session was opened or last reset,
+   all times in ns */
+typedef struct {
+	uint64_t samples, timeouts, corrupt;
+	uint64_t min, max;
+	double mean, stddev;
+	uint64_t p50, p90, p99, p999, p9999;
+	uint64_t wire;		/* the packet takes on the wire at the baud rate */
+} sl_stats_t;
+
+	void          sl_config_default(sl_config_t *c);
+	sl_session_t *sl_open(const char *port);
+	int           sl_configure(sl_session_t *s, const sl_config_t *c);
+	int           sl_sample(sl_session_t *s, uint64_t *latency_ns);
+	void          sl_stats(sl_session_t *s, sl_stats_t *st, int reset);
+	void          sl_close(sl_session_t *s);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef SLPREFIX_H
+#define SLPREFIX_H
+
+/* The modules in libseriallatency export their functions and variables
+ * under sl_ prefixed names, so they do not clash with the symbols of a
+ * program that embeds the library. Every header of such a module
+ * includes this file, and the code keeps using the plain names.
+ */
+
+/* hr_timer.h */
+#define ConvertTimeDifferenceToNs  sl_ConvertTimeDifferenceToNs
+#define ConvertTimeDifferenceToSec sl_ConvertTimeDifferenceToSec
+#define GetHighResolutionTime      sl_GetHighResolutionTime
+#define hr_timer_clock_ns          sl_hr_timer_clock_ns
+#define hr_timer_cost_ns           sl_hr_timer_cost_ns
+#define hr_timer_init              sl_hr_timer_init
+#define hr_timer_initialized       sl_hr_timer_initialized
+#define hr_timer_mult              sl_hr_timer_mult
+#define hr_timer_rdtsc             sl_hr_timer_rdtsc
+#define hr_timer_tsc               sl_hr_timer_tsc
+
+/* histogram.h */
+#define histogram_add         sl_histogram_add
+#define histogram_bucket      sl_histogram_bucket
+#define histogram_bucket_high sl_histogram_bucket_high
+#define histogram_bucket_low  sl_histogram_bucket_low
+#define histogram_count       sl_histogram_count
+#define histogram_merge       sl_histogram_merge
+#define histogram_percentile  sl_histogram_percentile
+#define histogram_rank        sl_histogram_rank
+#define histogram_reset       sl_histogram_reset
+#define histogram_stddev      sl_histogram_stddev
+
+/* packet.h */
+#define packet_crc16          sl_packet_crc16
+#define packet_decode         sl_packet_decode
+#define packet_encode         sl_packet_encode
+#define packet_set_turnaround sl_packet_set_turnaround
+#define packet_turnaround     sl_packet_turnaround
+
+/* probe.h */
+#define probe_free       sl_probe_free
+#define probe_init       sl_probe_init
+#define probe_recv       sl_probe_recv
+#define probe_send       sl_probe_send
+#define probe_stamp      sl_probe_stamp
+#define probe_turnaround sl_probe_turnaround
+
+/* serial.h */
+#define serial_baud_rate          sl_serial_baud_rate
+#define serial_close              sl_serial_close
+#define serial_flush              sl_serial_flush
+#define serial_frame_bits         sl_serial_frame_bits
+#define serial_get_xmit_fifo_size sl_serial_get_xmit_fifo_size
+#define serial_open               sl_serial_open
+#define serial_read               sl_serial_read
+#define serial_read_any           sl_serial_read_any
+#define serial_read_wait          sl_serial_read_wait
+#define serial_set_baud           sl_serial_set_baud
+#define serial_set_low_latency    sl_serial_set_low_latency
+#define serial_set_xmit_fifo_size sl_serial_set_xmit_fifo_size
+#define serial_wait_free          sl_serial_wait_free
+#define serial_wait_init          sl_serial_wait_init
+#define serial_wait_name          sl_serial_wait_name
+#define serial_wait_parse         sl_serial_wait_parse
+#define serial_write              sl_serial_write
+#define serial_writebyte          sl_serial_writebyte
+
+#endif